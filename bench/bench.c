@@ -0,0 +1,625 @@
+/*
+ * Benchmarks of JayceON, see the README for how to build and run them
+ *
+ * Every benchmark runs one operation over one corpus again and again for at
+ * least the given time, and prints a line of JSON with the rate of its fastest
+ * run. Parsing also counts the allocations it makes for one document, through
+ * an allocator that keeps tabs on them. Given the output of an earlier run as
+ * a baseline, the rates are compared against it.
+ *
+ * Corpora are passed as files, named by their file name without extension, a
+ * ".ndjson" extension makes a corpus of records. A deeply nested document, a
+ * wide object and records are always added, generated on the spot.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "jayceon.h"
+
+/* Fewest runs of every benchmark, however long they take */
+#define MIN_RUNS (3)
+/* Runs shorter than this are not timed precisely enough, so more is done in each */
+#define MIN_RUN_TIME (0.01)
+#define MAX_BATCH (1u << 20)
+
+typedef struct Corpus_ {
+	const char *name;
+	char *data;
+	size_t len;
+	int records;
+} Corpus;
+
+/* Ways of parsing that are benchmarked, by their parse flags */
+typedef struct Variant_ {
+	const char *name;
+	unsigned flags;
+} Variant;
+
+static const Variant variants[] = {
+	{ "default", 0 },
+	{ "structural_index", JY_PARSE_STRUCTURAL_INDEX },
+	{ "prescan", JY_PARSE_PRESCAN },
+	{ "string_views", JY_PARSE_STRING_VIEWS },
+	{ "hash_keys", JY_PARSE_HASH_KEYS }
+};
+
+/* Allocator that counts what goes through it, ahead of every block is its size */
+typedef struct Counter_ {
+	size_t allocs;
+	size_t bytes;
+	size_t current;
+	size_t peak;
+} Counter;
+
+typedef union Header_ {
+	size_t size;
+	double _double;
+	void *_pointer;
+} Header;
+
+/* Rate of an earlier run */
+typedef struct Baseline_ {
+	const char *corpus;
+	const char *op;
+	const char *variant;
+	double rate;
+} Baseline;
+
+/* Runs of a benchmark, each of which does the operation batch times */
+typedef struct Timing_ {
+	size_t batch;
+	size_t runs;
+	double best;
+	double total;
+} Timing;
+
+static Baseline *baselines;
+static size_t baseline_count;
+static double min_time = 1.0;
+
+static void *count_alloc(void *user, size_t size) {
+	Counter *counter;
+	Header *header;
+
+	counter = user;
+	header = malloc(sizeof(Header) + size);
+	if (!header)
+		return NULL;
+
+	header->size = size;
+
+	++counter->allocs;
+	counter->bytes += size;
+	counter->current += size;
+
+	if (counter->current > counter->peak)
+		counter->peak = counter->current;
+
+	return header + 1;
+}
+
+static void count_free(void *user, void *ptr) {
+	Counter *counter;
+	Header *header;
+
+	if (!ptr)
+		return;
+
+	counter = user;
+	header = (Header *) ptr - 1;
+	counter->current -= header->size;
+	free(header);
+}
+
+static double now(void) {
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+static char *read_file(const char *path, size_t *out_len) {
+	FILE *f;
+	char *data;
+	long size;
+
+	if (!(f = fopen(path, "rb")))
+		return NULL;
+
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+		fclose(f);
+		return NULL;
+	}
+
+	data = malloc((size_t) size + 1);
+	if (!data || fread(data, 1, (size_t) size, f) != (size_t) size) {
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+
+	data[size] = '\0';
+	fclose(f);
+
+	*out_len = (size_t) size;
+	return data;
+}
+
+/* Arrays holding objects holding arrays, and so on, nested almost 1000 levels deep */
+static char *gen_nested(size_t *out_len) {
+	const size_t CHAINS = 200, DEPTH = 480;
+	char *data, *w;
+	size_t i, j;
+
+	data = malloc(CHAINS * DEPTH * 10 + 16);
+	if (!data)
+		return NULL;
+
+	w = data;
+	*w++ = '[';
+
+	for (i = 0; i < CHAINS; ++i) {
+		if (i)
+			*w++ = ',';
+
+		for (j = 0; j < DEPTH; ++j)
+			w += sprintf(w, "{\"a\":[");
+
+		*w++ = '1';
+
+		for (j = 0; j < DEPTH; ++j)
+			w += sprintf(w, "]}");
+	}
+
+	*w++ = ']';
+	*w = '\0';
+
+	*out_len = (size_t) (w - data);
+	return data;
+}
+
+/* One object with a hundred thousand keys */
+static char *gen_wide(size_t *out_len) {
+	const size_t KEYS = 100000;
+	char *data, *w;
+	size_t i;
+
+	data = malloc(KEYS * 48 + 16);
+	if (!data)
+		return NULL;
+
+	w = data;
+	*w++ = '{';
+
+	for (i = 0; i < KEYS; ++i)
+		w += sprintf(w, i % 2 ? "%s\"key_%lu\":%lu" : "%s\"key_%lu\":\"value %lu\"", i ? "," : "", (unsigned long) i, (unsigned long) i);
+
+	*w++ = '}';
+	*w = '\0';
+
+	*out_len = (size_t) (w - data);
+	return data;
+}
+
+/* A hundred thousand small records, one per line */
+static char *gen_ndjson(size_t *out_len) {
+	const size_t RECORDS = 100000;
+	char *data, *w;
+	size_t i;
+
+	data = malloc(RECORDS * 128 + 16);
+	if (!data)
+		return NULL;
+
+	w = data;
+
+	for (i = 0; i < RECORDS; ++i)
+		w += sprintf(w, "{\"id\":%lu,\"name\":\"user %lu\",\"tags\":[\"a\",\"b\\n\"],\"score\":%lu.5,\"active\":%s}\n",
+			(unsigned long) i, (unsigned long) i, (unsigned long) (i % 1000), i % 3 ? "true" : "false");
+
+	*w = '\0';
+
+	*out_len = (size_t) (w - data);
+	return data;
+}
+
+static double find_baseline(const char *corpus, const char *op, const char *variant) {
+	size_t i;
+
+	for (i = 0; i < baseline_count; ++i) {
+		if (!strcmp(baselines[i].corpus, corpus) && !strcmp(baselines[i].op, op) && !strcmp(baselines[i].variant, variant))
+			return baselines[i].rate;
+	}
+
+	return 0.0;
+}
+
+/* Prints a result, along with how it compares to the baseline if there is one */
+static void report(const Corpus *corpus, const char *op, const char *variant, const char *unit, double rate, size_t runs, const Counter *counter) {
+	double base;
+
+	printf("{\"corpus\":\"%s\",\"op\":\"%s\",\"variant\":\"%s\",\"bytes\":%lu,\"runs\":%lu,\"unit\":\"%s\",\"rate\":%.2f",
+		corpus->name, op, variant, (unsigned long) corpus->len, (unsigned long) runs, unit, rate);
+
+	if (counter)
+		printf(",\"allocs\":%lu,\"alloc_bytes\":%lu,\"peak_bytes\":%lu",
+			(unsigned long) counter->allocs, (unsigned long) counter->bytes, (unsigned long) counter->peak);
+
+	base = find_baseline(corpus->name, op, variant);
+	if (base > 0.0)
+		printf(",\"baseline\":%.2f,\"ratio\":%.3f", base, rate / base);
+
+	printf("}\n");
+	fflush(stdout);
+}
+
+/* Looks up every key of every object in the value, the number of lookups is returned */
+static size_t index_keys(JYValue *val, size_t *sink) {
+	JYIterator it;
+	JYArray *arr;
+	JYObject *obj;
+	JYValue *elem;
+	const char *key;
+	size_t count;
+
+	count = 0;
+
+	if (jy_is_array(val, &arr)) {
+		jy_array_iter(arr, &it);
+
+		while ((elem = jy_array_next(&it)))
+			count += index_keys(elem, sink);
+	} else if (jy_is_object(val, &obj) && jy_object_iter(obj, &it)) {
+		while ((elem = jy_object_next(&it, &key))) {
+			*sink += jy_index_s(obj, key) == elem;
+			count += 1 + index_keys(elem, sink);
+		}
+	}
+
+	return count;
+}
+
+static void timing_init(Timing *t) {
+	t->batch = 1;
+	t->runs = 0;
+	t->best = -1.0;
+	t->total = 0.0;
+}
+
+static int timing_more(const Timing *t) {
+	return t->runs < MIN_RUNS || t->total < min_time;
+}
+
+/* Adds a run of a batch, or doubles the batch if the run was too short to time */
+static void timing_add(Timing *t, double seconds) {
+	t->total += seconds;
+
+	if (seconds < MIN_RUN_TIME && t->batch < MAX_BATCH) {
+		t->batch *= 2;
+		return;
+	}
+
+	seconds /= t->batch;
+	if (t->best < 0.0 || seconds < t->best)
+		t->best = seconds;
+
+	++t->runs;
+}
+
+static double timing_rate(const Timing *t, double amount) {
+	return t->best > 0.0 ? amount / t->best : 0.0;
+}
+
+static void bench_parse(const Corpus *corpus, const Variant *variant) {
+	JYAllocator allocator;
+	JYParseOptions opts;
+	JYDocument **docs, **grown;
+	Counter counter, first;
+	Timing parse;
+	double start, free_time;
+	size_t i, batch, capacity, freed;
+
+	memset(&counter, 0, sizeof(counter));
+	allocator.alloc = count_alloc;
+	allocator.free = count_free;
+	allocator.user = &counter;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.flags = variant->flags;
+	opts.allocator = &allocator;
+
+	docs = NULL;
+	capacity = 0;
+	freed = 0;
+	free_time = 0.0;
+	first = counter;
+	timing_init(&parse);
+
+	while (timing_more(&parse)) {
+		batch = parse.batch;
+
+		if (batch > capacity) {
+			if (!(grown = realloc(docs, batch * sizeof(JYDocument *)))) {
+				free(docs);
+				return;
+			}
+
+			docs = grown;
+			capacity = batch;
+		}
+
+		start = now();
+
+		for (i = 0; i < batch && (docs[i] = jy_parse_n_ex(corpus->data, corpus->len, &opts)); ++i);
+
+		timing_add(&parse, now() - start);
+
+		if (i < batch) {
+			fprintf(stderr, "%s: parsing failed with %s\n", corpus->name, variant->name);
+			parse.runs = 0;
+
+			while (i)
+				jy_free(docs[--i]);
+
+			break;
+		}
+
+		/* The allocations of the first document, which is parsed on its own */
+		if (!first.allocs)
+			first = counter;
+
+		start = now();
+
+		while (i)
+			jy_free(docs[--i]);
+
+		free_time += now() - start;
+		freed += batch;
+	}
+
+	free(docs);
+
+	if (!parse.runs)
+		return;
+
+	report(corpus, "parse", variant->name, "MB/s", timing_rate(&parse, corpus->len / 1e6), parse.runs, &first);
+
+	/* Freeing is timed as a whole, rather than by its fastest batch */
+	if (variant->flags == 0)
+		report(corpus, "free", variant->name, "MB/s", free_time > 0.0 ? freed * (corpus->len / 1e6) / free_time : 0.0, parse.runs, NULL);
+}
+
+static void bench_index(const Corpus *corpus) {
+	JYDocument *doc;
+	Timing index;
+	double start;
+	size_t i, batch, lookups, sink, total;
+
+	if (!(doc = jy_parse_n(corpus->data, corpus->len)))
+		return;
+
+	lookups = 0;
+	sink = 0;
+	total = 0;
+	timing_init(&index);
+
+	while (timing_more(&index)) {
+		batch = index.batch;
+		start = now();
+
+		for (i = 0; i < batch; ++i)
+			lookups = index_keys(jy_root_value(doc), &sink);
+
+		timing_add(&index, now() - start);
+		total += batch;
+	}
+
+	if (sink != lookups * total)
+		fprintf(stderr, "%s: lookups found the wrong values\n", corpus->name);
+
+	if (lookups)
+		report(corpus, "index", "default", "lookups/s", timing_rate(&index, (double) lookups), index.runs, NULL);
+
+	jy_free(doc);
+}
+
+static void bench_write(const Corpus *corpus, unsigned flags) {
+	JYDocument *doc;
+	Timing write;
+	double start;
+	size_t i, len;
+
+	if (!(doc = jy_parse_n(corpus->data, corpus->len)))
+		return;
+
+	len = 0;
+	timing_init(&write);
+
+	while (timing_more(&write)) {
+		start = now();
+
+		for (i = 0; i < write.batch; ++i)
+			free(jy_write_string(doc, flags, &len, NULL));
+
+		timing_add(&write, now() - start);
+	}
+
+	/* The rate is of the output, which is what the writer spends its time on */
+	report(corpus, "write", flags & JY_WRITE_PRETTY ? "pretty" : "default", "MB/s", timing_rate(&write, len / 1e6), write.runs, NULL);
+	jy_free(doc);
+}
+
+static void bench_records(const Corpus *corpus) {
+	JYAllocator allocator;
+	JYParseOptions opts;
+	JYRecords *records;
+	JYDocument *doc;
+	Counter counter;
+	Timing read;
+	double start;
+	size_t i;
+
+	allocator.alloc = count_alloc;
+	allocator.free = count_free;
+	allocator.user = &counter;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.allocator = &allocator;
+
+	timing_init(&read);
+
+	while (timing_more(&read)) {
+		start = now();
+
+		for (i = 0; i < read.batch; ++i) {
+			memset(&counter, 0, sizeof(counter));
+
+			if (!(records = jy_records_new(corpus->data, corpus->len, &opts)))
+				return;
+
+			while (jy_records_next(records, &doc)) {
+				if (!doc) {
+					fprintf(stderr, "%s: record %lu failed to parse\n", corpus->name, (unsigned long) jy_records_line(records));
+					break;
+				}
+			}
+
+			jy_records_free(records);
+		}
+
+		timing_add(&read, now() - start);
+	}
+
+	/* Records share one arena, so the allocations are those of the whole corpus */
+	report(corpus, "records", "default", "MB/s", timing_rate(&read, corpus->len / 1e6), read.runs, &counter);
+}
+
+/* Reads the results of an earlier run, which is itself made of records */
+static int load_baseline(const char *path) {
+	static const JYField fields[] = {
+		{ "corpus", JY_FIELD_STRING, offsetof(Baseline, corpus), 1 },
+		{ "op", JY_FIELD_STRING, offsetof(Baseline, op), 1 },
+		{ "variant", JY_FIELD_STRING, offsetof(Baseline, variant), 1 },
+		{ "rate", JY_FIELD_NUMBER, offsetof(Baseline, rate), 1 }
+	};
+	char *data, *line, *eol;
+	size_t len, capacity;
+
+	if (!(data = read_file(path, &len)))
+		return 0;
+
+	capacity = 0;
+
+	for (line = data; line < data + len; line = eol + 1) {
+		if (!(eol = memchr(line, '\n', (size_t) (data + len - line))))
+			eol = data + len;
+
+		if (baseline_count == capacity) {
+			Baseline *grown;
+
+			capacity = capacity ? capacity * 2 : 64;
+			grown = realloc(baselines, capacity * sizeof(Baseline));
+			if (!grown)
+				return 0;
+
+			baselines = grown;
+		}
+
+		/* The strings point into the data, which is kept for as long as the program runs */
+		if (jy_extract_insitu(line, (size_t) (eol - line), fields, sizeof(fields) / sizeof(fields[0]), &baselines[baseline_count], NULL))
+			++baseline_count;
+	}
+
+	return 1;
+}
+
+/* Takes the name of a corpus from the file name, without directories or extension */
+static const char *corpus_name(const char *path, int *records) {
+	const char *name, *dot;
+	char *copy;
+	size_t len;
+
+	name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+
+	dot = strrchr(name, '.');
+	len = dot ? (size_t) (dot - name) : strlen(name);
+	*records = dot && !strcmp(dot, ".ndjson");
+
+	copy = malloc(len + 1);
+	if (!copy)
+		return path;
+
+	memcpy(copy, name, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+static void run_corpus(const Corpus *corpus) {
+	size_t i;
+
+	if (corpus->records) {
+		bench_records(corpus);
+		return;
+	}
+
+	for (i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i)
+		bench_parse(corpus, &variants[i]);
+
+	bench_index(corpus);
+	bench_write(corpus, 0);
+	bench_write(corpus, JY_WRITE_PRETTY);
+}
+
+int main(int argc, char **argv) {
+	Corpus corpus;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			min_time = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+			if (!load_baseline(argv[++i])) {
+				fprintf(stderr, "could not read the baseline %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else {
+			fprintf(stderr, "usage: %s [-t seconds] [-b baseline] [corpus files...]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (; i < argc; ++i) {
+		corpus.name = corpus_name(argv[i], &corpus.records);
+
+		if (!(corpus.data = read_file(argv[i], &corpus.len))) {
+			fprintf(stderr, "could not read %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		run_corpus(&corpus);
+		free(corpus.data);
+	}
+
+	corpus.records = 0;
+	corpus.name = "nested";
+	if ((corpus.data = gen_nested(&corpus.len))) {
+		run_corpus(&corpus);
+		free(corpus.data);
+	}
+
+	corpus.name = "wide";
+	if ((corpus.data = gen_wide(&corpus.len))) {
+		run_corpus(&corpus);
+		free(corpus.data);
+	}
+
+	corpus.records = 1;
+	corpus.name = "ndjson";
+	if ((corpus.data = gen_ndjson(&corpus.len))) {
+		run_corpus(&corpus);
+		free(corpus.data);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -4,14 +4,44 @@
  * For information on how to use the API, read the header file
  * Compilation can be customized by defining the following macros:
  * 
- *   JAYCEON_STRING_GROWTH - Define a number to be the number of bytes that
- * are allocated when a string runs out of memory
+ *   JAYCEON_ARENA_BLOCK_SIZE - Define a number to be the size in bytes of the
+ * first block of a document's arena. Every following block is twice as big as
+ * the previous one, up to JAYCEON_ARENA_MAX_BLOCK_SIZE
  * 
- *   JAYCEON_ARRAY_GROWTH - Define a number to be the number of values that
- * are allocated when an array runs out of memory
+ *   JAYCEON_ARENA_MAX_BLOCK_SIZE - Define a number to be the maximum size in
+ * bytes of a block the arena allocates on its own (bigger requests still get a
+ * block of their exact size)
  * 
- *   JAYCEON_ARRAY_GROWTH - Define a number to be the number of pairs that are
- * allocated when an object runs out of memory
+ *   JAYCEON_HASH_MIN_PAIRS - Define a number to be the number of pairs an
+ * object needs to get a hash table when parsing with JY_PARSE_HASH_KEYS
+ * 
+ *   JAYCEON_MAX_DEPTH - Define a number to be the default for how deep arrays
+ * and objects can be nested, counting the root
+ * 
+ *   JAYCEON_WRITE_BUFFER_SIZE - Define a number to be the size in bytes of the
+ * buffer jy_write gathers output in before passing it to the callback
+ * 
+ *   JAYCEON_NO_SIMD - Disables the vectorized (SSE2, AVX2 or NEON) scanning of
+ * whitespace and strings, leaving only the portable code
+ * 
+ *   JAYCEON_NO_AVX2 - Disables the AVX2 scanners, which are otherwise picked at
+ * runtime on processors that support them
+ * 
+ *   JAYCEON_PARALLEL_CHUNK_SIZE - Define a number to be the default number of
+ * bytes every worker of jy_records_parallel parses at a time
+ * 
+ *   JAYCEON_PTHREADS - Runs the workers of jy_records_parallel on threads of
+ * their own, which needs linking against pthreads
+ * 
+ *   JAYCEON_NO_MMAP - Makes jy_parse_file read files into memory with stdio
+ * instead of mapping them on POSIX systems
+ * 
+ *   JAYCEON_STATS - Fills in the stats of the parse options, which parsing does
+ * not look at otherwise, so that counting costs nothing when it is not defined
+ * 
+ *   JAYCEON_STATS_TIME - Also times the parsing of numbers and strings for the
+ * stats, implying JAYCEON_STATS. Every one of them is timed with clock(), which
+ * can take longer than parsing it, so the times are better compared than added
  * 
  *   JAYCEON_NO_COMMENT_SUPPORT - Disables comment support. When this is not
  * defined, comments are simply ignored, but if it is, the parser fails when
@@ -44,55 +74,215 @@
  *
  * For more information, please refer to <https://unlicense.org>
  */
+#if !defined(JAYCEON_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define USE_MMAP
+/*
+ * Makes posix_madvise visible even when compiling as strict ANSI C, without it
+ * the file is mapped without hints
+ */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
+#include <locale.h>
 
 #include "jayceon.h"
 
-#ifndef JAYCEON_STRING_GROWTH
-#define JAYCEON_STRING_GROWTH (16)
+#ifdef JAYCEON_PTHREADS
+#include <pthread.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef JAYCEON_STATS_TIME
+#include <time.h>
+#ifndef JAYCEON_STATS
+#define JAYCEON_STATS
+#endif
+#endif
+
+#ifdef USE_MMAP
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if !defined(JAYCEON_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMD_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && !defined(JAYCEON_NO_AVX2)
+#define SIMD_AVX2
+#include <immintrin.h>
+#endif
+#elif !defined(JAYCEON_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__) && defined(__GNUC__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#ifndef JAYCEON_ARENA_BLOCK_SIZE
+#define JAYCEON_ARENA_BLOCK_SIZE (4096)
+#endif
+
+#ifndef JAYCEON_ARENA_MAX_BLOCK_SIZE
+#define JAYCEON_ARENA_MAX_BLOCK_SIZE (1048576)
+#endif
+
+#ifndef JAYCEON_PARALLEL_CHUNK_SIZE
+#define JAYCEON_PARALLEL_CHUNK_SIZE (4194304)
+#endif
+
+#ifndef JAYCEON_MAX_DEPTH
+#define JAYCEON_MAX_DEPTH (1024)
 #endif
 
-#ifndef JAYCEON_ARRAY_GROWTH
-#define JAYCEON_ARRAY_GROWTH (16)
+#ifndef JAYCEON_WRITE_BUFFER_SIZE
+#define JAYCEON_WRITE_BUFFER_SIZE (4096)
 #endif
 
-#ifndef JAYCEON_OBJECT_GROWTH
-#define JAYCEON_OBJECT_GROWTH (16)
+#ifndef JAYCEON_HASH_MIN_PAIRS
+#define JAYCEON_HASH_MIN_PAIRS (16)
 #endif
 
+/* Hooks that the stats are counted through, which are gone without them */
+#ifdef JAYCEON_STATS
+#define COUNT_MEMORY(p, allocated, freed, grown) count_memory((p), (allocated), (freed), (grown))
+#define COUNT_CONTAINER(p, object, depth) count_container((p), (object), (depth))
+#else
+#define COUNT_MEMORY(p, allocated, freed, grown) ((void) 0)
+#define COUNT_CONTAINER(p, object, depth) ((void) 0)
+#endif
+
+/* Seconds of processor time, which are only taken when timing the stats */
+#ifdef JAYCEON_STATS_TIME
+#define STATS_CLOCK() ((double) clock() / CLOCKS_PER_SEC)
+#else
+#define STATS_CLOCK() (0.0)
+#endif
+
+/* Compares keys, which are the same pointer if they come from a key table */
+#define COMPARE_KEYS(a, b) ((a) == (b) ? 0 : strcmp((a), (b)))
+
+/* Length of the runs that are insertion sorted before merging them */
+#define SORT_RUN (8)
+
+/* Every arena allocation is aligned to the size of this union */
+typedef union Align_ {
+	double _double;
+	void *_pointer;
+	long _long;
+	size_t _size;
+} Align;
+
+/* Whitespace between tokens */
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+/* Characters that end a plain run of a string */
+#define IS_SPECIAL(c) ((c) == '\"' || (c) == '\\' || (unsigned char) (c) < 0x20)
+
+/* Characters that can follow the first one of a number, true, false or null */
+#define IS_SCALAR(c) (((c) >= 'a' && (c) <= 'z') || ((c) >= '0' && (c) <= '9') || \
+	(c) == '.' || (c) == '-' || (c) == '+' || (c) == 'E')
+
+/* Character at the position, or '\0' past the end of the input */
+#define PEEK(p, s) ((s) < (p)->end ? *(s) : '\0')
+
+#define ALIGN_UP(n) (((n) + sizeof(Align) - 1) / sizeof(Align) * sizeof(Align))
+
+/* Bytes in front of the pairs of an object for a hash table of the size and its mask */
+#define TABLE_BYTES(size) ((size) ? ALIGN_UP(((size) + 1) * sizeof(Index)) : 0)
+
+/* Where the contents of a string, array or object of a snapshot are */
+#define SNAPSHOT_DATA(val) ((char *) (val) + (val)->value._offset)
+
+/* Position in the input, or in an array of a document, of up to 32 bits */
+#if UINT_MAX >= 0xFFFFFFFFu
+typedef unsigned int Index;
+#else
+typedef unsigned long Index;
+#endif
+
+#define INDEX_MAX (0xFFFFFFFFul)
+
+/* Unsigned counterpart of JYInt64 */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+typedef uint64_t UInt64;
+#elif defined(_MSC_VER)
+typedef unsigned __int64 UInt64;
+#elif defined(__GNUC__)
+__extension__ typedef unsigned long long UInt64;
+#else
+typedef unsigned long UInt64;
+#endif
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
 typedef enum Type_ {
 	TYPE_NULL,
 	TYPE_BOOL,
 	TYPE_NUMBER,
+	TYPE_INTEGER,
 	TYPE_STRING,
+	TYPE_VIEW,
+	TYPE_ESCAPED_VIEW,
 	TYPE_ARRAY,
-	TYPE_OBJECT
+	TYPE_OBJECT,
+	TYPE_LAZY_ARRAY,
+	TYPE_LAZY_OBJECT,
+	TYPE_NODE,
+	TYPE_SNAPSHOT_STRING,
+	TYPE_SNAPSHOT_ARRAY,
+	TYPE_SNAPSHOT_OBJECT
 } Type;
 
-struct JYArray_ {
-	JYValue *values;
-	size_t count;
-	size_t capacity;
-};
-
-struct JYObject_ {
-	struct Pair_ *pairs;
-	size_t count;
-	size_t capacity;
-};
-
+/*
+ * Values are kept to two words: the payload, and the length of a string or the
+ * count of a container, which limits both to INDEX_MAX. Whatever does not fit,
+ * like views and lazy subtrees, is held out of line. So are arrays and objects
+ * made with jy_set_array and jy_set_object, as nodes, so that they stay where
+ * they are when the container holding them moves its elements. Strings, arrays
+ * and objects of snapshots point to their contents by an offset from the value
+ * itself instead, so that snapshots can be used wherever they are mapped.
+ */
 struct JYValue_ {
-	Type type;
 	union {
 		int _bool;
 		double _number;
+		JYInt64 _integer;
 		char *_string;
-		JYArray _array;
-		JYObject _object;
+		struct View_ *_view;
+		struct Span_ *_span;
+		JYValue *_values;
+		struct Pair_ *_pairs;
+		JYValue *_node;
+		ptrdiff_t _offset;
 	} value;
+	Index length;
+	unsigned char type;
+	unsigned char hashed;
+	unsigned char growable;
+};
+
+/* Arrays and objects are handed out as the values holding them */
+struct JYArray_ {
+	JYValue val;
+};
+
+/*
+ * Pairs are sorted by their keys. Wide objects can also have a hash table of
+ * pair indices plus one (zero marks an empty slot) right in front of their
+ * pairs, which ends with the mask of its size
+ */
+struct JYObject_ {
+	JYValue val;
 };
 
 typedef struct Pair_ {
@@ -100,673 +290,6448 @@ typedef struct Pair_ {
 	JYValue value;
 } Pair;
 
+/* Pair of a snapshot object, its key is at an offset from the entry */
+typedef struct Entry_ {
+	ptrdiff_t key;
+	JYValue value;
+} Entry;
+
+/*
+ * Arrays and objects that were changed keep their elements in memory with room
+ * to grow, which starts with this header. Pairs past the sorted ones were added
+ * since the object was last looked into, they are merged in on the next lookup.
+ * Until then, they are found by a hash table of their indices plus one, which
+ * is kept at most half full and is emptied by merging.
+ */
+typedef struct Growth_ {
+	JYArena *arena;
+	size_t capacity;
+	size_t sorted;
+	Index *added;
+	size_t mask;
+} Growth;
+
+#define GROWTH_BYTES (ALIGN_UP(sizeof(Growth)))
+
+typedef struct String_ {
+	char *chars;
+	size_t length;
+} String;
+
+/*
+ * Views point into the input which is still to be copied (and decoded, if it
+ * contains escape sequences) into the arena
+ */
+typedef struct View_ {
+	const char *chars;
+	JYArena *arena;
+} View;
+
+/* Arrays and objects of lazy documents which are yet to be parsed */
+typedef struct Span_ {
+	const char *chars;
+	JYDocument *doc;
+} Span;
+
+/* Contents of an input file, either mapped or read into allocated memory */
+typedef struct File_ {
+	char *data;
+	size_t size;
+	int mapped;
+} File;
+
 struct JYDocument_ {
-	JYObject root;
+	JYValue root;
+	JYArena *arena;
+	File file;
+	JYKeyTable *keys;
+	int owns_arena;
+	unsigned flags;
+	int insitu;
+	size_t max_depth;
 };
 
-static const char *parse_space(const char *string);
-static const char *parse_null(const char *string);
-static const char *parse_bool(const char *string, int *out);
-static const char *parse_number(const char *string, double *out);
-static const char *parse_string(const char *string, char **out);
-static const char *parse_array(const char *string, JYArray *out);
-static const char *parse_object(const char *string, JYObject *out);
-static const char *parse_value(const char *string, JYValue *out);
+/* Key of a key table, along with what it takes to find it */
+typedef struct Key_ {
+	const char *chars;
+	size_t length;
+	unsigned long hash;
+} Key;
+
+/*
+ * Keys are copied into the table's arena, and found by open addressing in its
+ * slots, which are kept at most half full
+ */
+struct JYKeyTable_ {
+	JYArena *arena;
+	Key *slots;
+	size_t mask;
+	size_t count;
+	int frozen;
+};
 
-static void free_value(JYValue *val);
-static void free_array(JYArray *array);
-static void free_object(JYObject *object);
+/*
+ * Arena memory is split into blocks which are chained in the order they were
+ * allocated in. Allocation bumps the current block, and moves on to the next
+ * one (allocating it if needed) when the current one is full. Resetting the
+ * arena rewinds it to the first block and keeps all of them for reuse.
+ */
+typedef union Block_ {
+	struct {
+		union Block_ *next;
+		size_t size;
+		size_t used;
+	} header;
+	Align align;
+} Block;
+
+struct JYArena_ {
+	JYAllocator allocator;
+	Block *first;
+	Block *current;
+	size_t next_size;
+	int owned;
+#ifdef JAYCEON_STATS
+	size_t allocs;
+	size_t allocated;
+#endif
+};
 
-static double pow10(double x, int y) {
-	int i;
+typedef struct Mark_ {
+	Block *block;
+	size_t used;
+} Mark;
 
-	if (abs(y) > 30)
-		return 0.0;
+typedef const char *(*Scanner)(const char *string, const char *end);
 
-	for (i = 0; i < y; ++i)
-		x *= 10.0;
+/* Number of characters classified at once by the structural index engine */
+#define BLOCK_SIZE (32)
 
-	for (i = 0; i < -y; ++i)
-		x *= 0.1;
-	
-	return x;
+/* Character classes of a block, one bit per character */
+typedef struct Masks_ {
+	unsigned long backslash;
+	unsigned long quote;
+	unsigned long op;
+	unsigned long space;
+	unsigned long slash;
+} Masks;
+
+typedef void (*Classifier)(const char *block, Masks *out);
+
+
+#define INDEX_OK (0)
+#define INDEX_FAILED (1)
+#define INDEX_UNSUPPORTED (2)
+
+/*
+ * Values of arrays and pairs of objects are collected on this stack while they
+ * are being parsed, and moved into the arena once the container is closed, so
+ * that all of them are of their exact size. With the pre-scan, the count of
+ * elements of every container is known beforehand instead, so they are parsed
+ * straight into the arena. The first error the parser runs into is kept, with
+ * the first position that any of the parsers failing on it knew of. For the
+ * stats, the temporary memory the parser holds is counted, and the arena's
+ * counts of its blocks from before parsing.
+ */
+typedef struct Parser_ {
+	const char *end;
+	Scanner skip_space;
+	Scanner scan_plain;
+	Scanner scan_ascii;
+	Classifier classify;
+	const char *begin;
+	Index *index;
+	size_t count;
+	size_t next;
+	size_t *counts;
+	size_t containers;
+	size_t next_container;
+	int insitu;
+	int views;
+	int hash;
+	int prescan;
+	int lazy;
+	int utf8;
+	size_t depth;
+	size_t max_depth;
+	int error;
+	const char *error_at;
+	const JYHandler *handler;
+	JYDocument *doc;
+	JYArena *arena;
+	JYKeyTable *keys;
+	const JYAllocator *allocator;
+	char *stack;
+	size_t top;
+	size_t capacity;
+#ifdef JAYCEON_STATS
+	JYStats *stats;
+	int counting;
+	size_t memory;
+	size_t arena_allocs;
+	size_t arena_allocated;
+#endif
+	Align inline_stack[64];
+} Parser;
+
+/* Elements of the container being parsed, and the arena memory counted for them */
+typedef struct Elements_ {
+	char *slots;
+	size_t capacity;
+	size_t count;
+	size_t base;
+} Elements;
+
+/* Kind of the token the push parser is in the middle of */
+#define LEX_NONE (0)
+#define LEX_STRING (1)
+#define LEX_SCALAR (2)
+#define LEX_SLASH (3)
+#define LEX_LINE_COMMENT (4)
+#define LEX_BLOCK_COMMENT (5)
+
+/* What the push parser expects next in a container */
+#define EXPECT_VALUE (0)
+#define EXPECT_ELEMENT (1)
+#define EXPECT_KEY (2)
+#define EXPECT_COLON (3)
+#define EXPECT_COMMA (4)
+
+#define PUSH_MORE (0)
+#define PUSH_DONE (1)
+#define PUSH_FAILED (2)
+
+/* Container that a parser is inside of, and what it expects there next */
+typedef struct Frame_ {
+	Elements e;
+	char *key;
+	int object;
+	int expect;
+} Frame;
+
+/*
+ * The push parser keeps what the recursive descent engine has on the call stack
+ * in frames instead, so that it can stop at the end of any chunk. Tokens that
+ * go on past the end of a chunk are collected until they are complete, and are
+ * then handed to the same parsers as usual. For errors, the position of the
+ * start of the chunk is kept, and of the token if it is being collected.
+ */
+struct JYParser_ {
+	Parser p;
+	JYAllocator allocator;
+	JYDocument *doc;
+	int owns_arena;
+	Frame *frames;
+	size_t depth;
+	size_t capacity;
+	char *token;
+	size_t length;
+	size_t token_capacity;
+	int lex;
+	int escape;
+	int started;
+	int status;
+	JYError *error;
+	JYError pos;
+	JYError token_pos;
+	const char *chunk;
+};
+
+/*
+ * Every record is parsed into the same arena, which is reset before each one.
+ * Errors are moved from the record to the buffer, from the start of its line.
+ */
+struct JYRecords_ {
+	const char *begin;
+	const char *start;
+	const char *next;
+	const char *end;
+	size_t line;
+	size_t lines;
+	JYParseOptions opts;
+	JYAllocator allocator;
+	JYArena *arena;
+	int owns_arena;
+};
+
+typedef struct Result_ {
+	size_t line;
+	JYDocument *doc;
+} Result;
+
+/*
+ * Workers of jy_records_parallel parse a slice of the buffer at a time, keeping
+ * all of its documents in their arena until they have been reported
+ */
+typedef struct Worker_ {
+	JYRecords records;
+	Result *results;
+	size_t count;
+	size_t capacity;
+	int failed;
+#ifdef JAYCEON_PTHREADS
+	pthread_t thread;
+	int joinable;
+#endif
+} Worker;
+
+/*
+ * A step of a path is a key or, in an array, an index. Keys that are no valid
+ * index have an index of (size_t) -1, which no array gets to.
+ */
+typedef struct Step_ {
+	const char *key;
+	size_t length;
+	unsigned long hash;
+	size_t index;
+} Step;
+
+/* Steps are allocated right after the path, followed by their keys */
+struct JYPath_ {
+	JYAllocator allocator;
+	Step *steps;
+	size_t count;
+};
+
+/*
+ * Output of jy_write is gathered in a buffer, which is passed to the callback
+ * whenever it is full. Without a callback, the buffer is grown instead.
+ */
+typedef struct Writer_ {
+	JYWriteCallback callback;
+	void *user;
+	const JYAllocator *allocator;
+	char *buf;
+	size_t length;
+	size_t capacity;
+	Scanner scan_plain;
+	unsigned flags;
+	size_t depth;
+	int failed;
+} Writer;
+
+#define SNAPSHOT_MAGIC "jysnap1"
+
+/* Written the same way on every machine, read differently on others */
+#define SNAPSHOT_ORDER (0x01020304ul)
+
+/* Snapshots can only be used by builds that lay values out the same way */
+#define SNAPSHOT_LAYOUT ((Index) (sizeof(JYValue) | sizeof(Entry) << 8 | sizeof(Align) << 16 | sizeof(ptrdiff_t) << 24))
+
+/* Snapshots start with this header, followed by the contents of the root */
+typedef struct SnapshotHeader_ {
+	char magic[8];
+	Index order;
+	Index layout;
+	size_t size;
+	JYValue root;
+} SnapshotHeader;
+
+/* Key of a snapshot, and where it is among its keys */
+typedef struct SnapshotKey_ {
+	const char *chars;
+	size_t length;
+	size_t offset;
+	unsigned long hash;
+} SnapshotKey;
+
+/*
+ * Snapshots are written in two passes over the document: the first one works
+ * out how big the contents of every value are and collects the keys, so that
+ * the second one can lay everything out in a single buffer. Every key is kept
+ * once, after the values.
+ */
+typedef struct Snapshot_ {
+	const JYAllocator *allocator;
+	char *buf;
+	size_t length;
+	size_t keys;
+	SnapshotKey *slots;
+	size_t mask;
+	size_t count;
+	size_t key_bytes;
+	int failed;
+} Snapshot;
+
+static JYDocument *parse_document(const char *buf, size_t len, const JYParseOptions *opts, int insitu);
+static int open_file(File *file, const char *path, const JYAllocator *allocator);
+static int read_file(File *file, const char *path, const JYAllocator *allocator);
+static void close_file(File *file, const JYAllocator *allocator);
+static const JYAllocator *file_allocator(const JYParseOptions *opts);
+static void keep_file(JYDocument *doc, File *file);
+static void init_parser(Parser *p, const char *end, unsigned flags, int insitu, JYArena *arena, const JYAllocator *allocator);
+static void set_error(Parser *p, int code, const char *at);
+static void report_error(JYError *error, int code, const char *buf, const char *at);
+static void count_position(JYError *pos, const char *string, const char *end);
+static int parse_root(Parser *p, const char *string, JYValue *out);
+static const char *end_root(Parser *p, const char *string, const char *end);
+static int parse_lazy(JYValue *val);
+static const char *skip_container(Parser *p, const char *string);
+
+static void select_scanners(Parser *p);
+
+static const char *find_path(Parser *p, const char *string, const JYPath *path, JYValue *out);
+static const char *find_key(Parser *p, const char *string, const Step *step);
+static const char *find_index(Parser *p, const char *string, size_t index);
+static const char *skip_value(Parser *p, const char *string);
+
+static int extract(const char *buf, size_t len, const JYField *fields, size_t count, void *out, const JYParseOptions *opts, int insitu);
+static const char *extract_fields(Parser *p, const char *string, const JYField *fields, size_t count, void *out);
+static size_t find_field(const JYField *fields, size_t count, size_t next, const char *key, size_t len);
+static const char *extract_value(Parser *p, const char *string, const JYField *field, void *out);
+
+static int write_document(Writer *w, JYDocument *doc);
+static void write_bytes(Writer *w, const char *data, size_t len);
+static void write_indent(Writer *w);
+static void write_value(Writer *w, JYValue *val);
+static void write_array(Writer *w, JYArray *arr);
+static void write_object(Writer *w, JYObject *obj);
+static void write_string(Writer *w, const char *str, size_t len);
+static void write_number(Writer *w, double num);
+static void write_decimal(Writer *w, int negative, UInt64 mant, int decimals);
+static void write_integer(Writer *w, JYInt64 num);
+
+static void measure_value(Snapshot *s, JYValue *val);
+static void copy_value(Snapshot *s, JYValue *to, JYValue *from);
+static SnapshotKey *snapshot_key(Snapshot *s, const char *key);
+static int grow_snapshot_keys(Snapshot *s);
+static size_t table_size(JYValue *obj);
+#ifndef NDEBUG
+static int print_chunk(void *user, const char *data, size_t len);
+#endif
+
+static const char *parse_space(Parser *p, const char *string);
+static const char *parse_null(Parser *p, const char *string);
+static const char *parse_bool(Parser *p, const char *string, int *out);
+static const char *parse_number(Parser *p, const char *string, JYValue *out);
+static int convert_number(Parser *p, const char *string, const char *end, double *out);
+static const char *scan_string(Parser *p, const char *string, int *escaped);
+static size_t decode_string(const char *string, const char *end, char *out);
+static const char *scan_escape(const char *string, const char *end);
+static const char *scan_utf8(const char *string, const char *end);
+static long read_hex(const char *string, const char *end);
+static size_t encode_utf8(unsigned long code, char *out);
+static const char *parse_string(Parser *p, const char *string, String *out);
+static const char *parse_key(Parser *p, const char *string, char **out);
+static const char *parse_view(Parser *p, const char *string, JYValue *out);
+static const char *parse_container(Parser *p, const char *string, JYValue *out);
+static const char *open_container(Parser *p, const char *string, Elements *e);
+static const char *parse_value(Parser *p, const char *string, JYValue *out);
+static const char *parse_scalar(Parser *p, const char *string, JYValue *out);
+
+static const char *sax_value(Parser *p, const char *string);
+static const char *sax_container(Parser *p, const char *string);
+static const char *sax_open(Parser *p, const char *string, size_t base, size_t *level);
+static const char *sax_string(Parser *p, const char *string, int key);
+static int sax_scalar(Parser *p, JYValue *val);
+
+static const char *push_token(JYParser *parser, const char *start, const char *string, const char *end);
+static const char *scan_token(JYParser *parser, const char *string, const char *end);
+static int push_lexeme(JYParser *parser, const char *string, const char *end);
+static int push_op(JYParser *parser, char c);
+static int push_value(JYParser *parser, JYValue *val);
+static void push_error(JYParser *parser, const JYError *from, const char *string, const char *at);
+
+static const char *next_record(JYRecords *records, const char **eol);
+static void *run_worker(void *arg);
+
+static int index_structurals(Parser *p, const char *buf, size_t len);
+static const char *next_structural(Parser *p);
+static int skip_structural(Parser *p, char c);
+static int build_container(Parser *p, char c, JYValue *out);
+static int open_indexed(Parser *p, int object, Elements *e);
+static int parse_indexed(Parser *p, const char *buf, size_t len, JYValue *out);
+
+static void count_elements(Parser *p, const char *string);
+static void count_indexed(Parser *p);
+static int count_token(Parser *p, char c, size_t *capacity, int *fresh);
+static void discard_counts(Parser *p, int res);
+
+static void open_elements(Parser *p, Elements *e, size_t size, int object);
+static int push_element(Parser *p, Elements *e, const void *data, size_t size);
+static int pop_values(Parser *p, Elements *e, JYValue *out);
+static int pop_pairs(Parser *p, Elements *e, JYValue *out);
+static Pair *sort_pairs(Pair *pairs, Pair *scratch, size_t count, int duplicates);
+static Pair *find_pair(Pair *pairs, size_t count, const char *key);
+static JYValue *find_value(JYObject *obj, const char *key, unsigned long hash);
+static JYValue *find_entry(JYObject *obj, const char *key, unsigned long hash);
+static JYValue *array_values(JYValue *arr);
+static size_t hash_size(Parser *p, size_t count);
+static void hash_pairs(JYValue *obj, size_t size);
+static unsigned long hash_key(const char *key);
+static const char *intern_key(JYKeyTable *table, const char *chars, size_t length);
+static int grow_keys(JYKeyTable *table);
+
+static void *default_alloc(void *user, size_t size);
+static void default_free(void *user, void *ptr);
+
+static const JYAllocator default_allocator = {
+	default_alloc,
+	default_free,
+	NULL
+};
+
+static void *arena_alloc(JYArena *arena, size_t size);
+static void arena_shrink(JYArena *arena, void *ptr, size_t size, size_t newsize);
+static int arena_extend(JYArena *arena, void *ptr, size_t size, size_t newsize);
+static Mark arena_mark(JYArena *arena);
+static void arena_rewind(JYArena *arena, Mark mark);
+
+static void *stack_push(Parser *p, const void *data, size_t size);
+static void *parser_alloc(Parser *p, size_t size);
+#ifdef JAYCEON_STATS
+static void count_memory(Parser *p, size_t allocated, size_t freed, int grown);
+static void count_container(Parser *p, int object, size_t depth);
+static const char *count_scalar(Parser *p, const char *string, JYValue *out);
+static const char *count_key(Parser *p, const char *string, char **out);
+static void finish_stats(Parser *p, Mark mark);
+#endif
+
+static Growth *get_growth(JYValue *val);
+static int reserve_element(JYDocument *doc, JYValue *val, size_t size);
+static int merge_pairs(JYValue *obj);
+static Index *find_added(Growth *growth, Pair *pairs, const char *key, unsigned long hash);
+static int reserve_added(JYDocument *doc, Growth *growth, Pair *pairs, size_t length);
+static JYValue *new_node(JYDocument *doc, JYValue *val, Type type);
+
+/* Powers of ten which are exact doubles */
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Integers up to it are exact doubles */
+#define EXACT_MANTISSA (9007199254740992.0)
+
+const char *jy_error_string(int code) {
+	switch (code) {
+		case JY_ERROR_NONE:
+			return "no error";
+
+		case JY_ERROR_SYNTAX:
+			return "syntax error";
+
+		case JY_ERROR_STRING:
+			return "invalid string";
+
+		case JY_ERROR_DUPLICATE_KEY:
+			return "duplicate key";
+
+		case JY_ERROR_DEPTH:
+			return "nested too deep";
+
+		case JY_ERROR_TOO_LARGE:
+			return "too large";
+
+		case JY_ERROR_MEMORY:
+			return "out of memory";
+
+		case JY_ERROR_NOT_FOUND:
+			return "not found";
+
+		case JY_ERROR_IO:
+			return "file could not be read";
+
+		case JY_ERROR_TYPE:
+			return "wrong type";
+
+		default:
+			return "unknown error";
+	}
 }
 
 JYDocument *jy_parse(const char *string) {
+	return jy_parse_n_ex(string, strlen(string), NULL);
+}
+
+JYDocument *jy_parse_ex(const char *string, const JYParseOptions *opts) {
+	return jy_parse_n_ex(string, strlen(string), opts);
+}
+
+JYDocument *jy_parse_n(const char *buf, size_t len) {
+	return jy_parse_n_ex(buf, len, NULL);
+}
+
+JYDocument *jy_parse_n_ex(const char *buf, size_t len, const JYParseOptions *opts) {
+	return parse_document(buf, len, opts, 0);
+}
+
+JYDocument *jy_parse_insitu(char *buf, size_t len, const JYParseOptions *opts) {
+	return parse_document(buf, len, opts, 1);
+}
+
+JYDocument *jy_parse_file(const char *path, const JYParseOptions *opts) {
+	const JYAllocator *allocator;
 	JYDocument *doc;
+	File file;
 
-	doc = malloc(sizeof(*doc));
-	if (!doc) {
-		return NULL;
-	}
+	allocator = file_allocator(opts);
+
+	if (!open_file(&file, path, allocator)) {
+		if (opts && opts->error)
+			report_error(opts->error, JY_ERROR_IO, "", "");
 
-	if (!parse_object(string, &doc->root)) {
-		free(doc);
 		return NULL;
 	}
 
+	doc = parse_document(file.data, file.size, opts, 0);
+
+	/* Only string views and lazy values still point into the file once parsed */
+	if (doc && (doc->flags & (JY_PARSE_STRING_VIEWS | JY_PARSE_LAZY)))
+		keep_file(doc, &file);
+	else
+		close_file(&file, allocator);
+
 	return doc;
 }
 
-void jy_free(JYDocument *doc) {
-	free_object(&doc->root);
-	free((void *) doc);
+/* The file is freed along with the document, by the allocator of its arena */
+static const JYAllocator *file_allocator(const JYParseOptions *opts) {
+	if (opts && opts->arena)
+		return &opts->arena->allocator;
+
+	return opts && opts->allocator ? opts->allocator : &default_allocator;
 }
 
-JYObject *jy_root(JYDocument *doc) {
-	return &doc->root;
+/* Hands the file over to the document, which is now read in any order */
+static void keep_file(JYDocument *doc, File *file) {
+#ifdef POSIX_MADV_NORMAL
+	if (file->mapped)
+		posix_madvise(file->data, file->size, POSIX_MADV_NORMAL);
+#endif
+
+	doc->file = *file;
 }
 
-JYValue *jy_index_s(JYObject *obj, const char *key) {
+/*
+ * Maps the file where that is supported, and reads it into memory otherwise or
+ * if mapping fails
+ */
+static int open_file(File *file, const char *path, const JYAllocator *allocator) {
+#ifdef USE_MMAP
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	/* Only regular files have a size, and empty ones cannot be mapped */
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || (UInt64) st.st_size > (size_t) -1) {
+		close(fd);
+		return 0;
+	}
+
+	if (!st.st_size) {
+		close(fd);
+		return read_file(file, path, allocator);
+	}
+
+	data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return read_file(file, path, allocator);
+
+	/* The parser reads it from start to end, so the kernel can read ahead */
+#ifdef POSIX_MADV_SEQUENTIAL
+	posix_madvise(data, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	file->data = data;
+	file->size = (size_t) st.st_size;
+	file->mapped = 1;
+	return 1;
+#else
+	return read_file(file, path, allocator);
+#endif
+}
+
+/* Reads the whole file into memory from the allocator */
+static int read_file(File *file, const char *path, const JYAllocator *allocator) {
+	FILE *f;
+	long size;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return 0;
+
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+		fclose(f);
+		return 0;
+	}
+
+	/* Empty files still get memory, so that the data is not NULL */
+	file->data = allocator->alloc(allocator->user, size ? (size_t) size : 1);
+	if (!file->data) {
+		fclose(f);
+		return 0;
+	}
+
+	file->size = fread(file->data, 1, (size_t) size, f);
+	file->mapped = 0;
+
+	if (file->size != (size_t) size || ferror(f)) {
+		allocator->free(allocator->user, file->data);
+		fclose(f);
+		return 0;
+	}
+
+	fclose(f);
+	return 1;
+}
+
+static void close_file(File *file, const JYAllocator *allocator) {
+#ifdef USE_MMAP
+	if (file->mapped) {
+		munmap(file->data, file->size);
+		return;
+	}
+#endif
+
+	allocator->free(allocator->user, file->data);
+}
+
+static JYDocument *parse_document(const char *buf, size_t len, const JYParseOptions *opts, int insitu) {
+	JYDocument *doc;
+	JYArena *arena;
+	Parser p;
+	Mark mark;
+	unsigned flags;
+	int owns_arena;
+
+#ifdef JAYCEON_STATS
+	if (opts && opts->stats)
+		memset(opts->stats, 0, sizeof(*opts->stats));
+#endif
+
+	if (opts && opts->arena) {
+		arena = opts->arena;
+		owns_arena = 0;
+	} else {
+		arena = jy_arena_new(NULL, 0, opts ? opts->allocator : NULL);
+		if (!arena) {
+			if (opts && opts->error)
+				report_error(opts->error, JY_ERROR_MEMORY, buf, buf);
+
+			return NULL;
+		}
+
+		owns_arena = 1;
+	}
+
+	mark = arena_mark(arena);
+
+	flags = opts ? opts->flags : 0;
+	init_parser(&p, buf + len, flags, insitu, arena, &arena->allocator);
+
+#ifdef JAYCEON_STATS
+	/* The blocks of an arena of the document's own count towards it as well */
+	p.stats = opts ? opts->stats : NULL;
+	p.arena_allocs = owns_arena ? 0 : arena->allocs;
+	p.arena_allocated = owns_arena ? 0 : arena->allocated;
+#endif
+
+	doc = arena_alloc(arena, sizeof(*doc));
+	if (doc) {
+		int res;
+
+		doc->arena = arena;
+		doc->keys = opts ? opts->keys : NULL;
+		doc->owns_arena = owns_arena;
+		doc->flags = flags;
+		doc->insitu = insitu;
+		doc->file.data = NULL;
+		doc->max_depth = opts && opts->max_depth ? opts->max_depth : JAYCEON_MAX_DEPTH;
+		p.doc = doc;
+		p.keys = doc->keys;
+		p.max_depth = doc->max_depth;
+
+		res = INDEX_UNSUPPORTED;
+
+		/* Lazy subtrees are parsed one at a time, so only recursive descent fits */
+		if ((flags & JY_PARSE_STRUCTURAL_INDEX) && !p.lazy)
+			res = parse_indexed(&p, buf, len, &doc->root);
+
+		if (res == INDEX_UNSUPPORTED) {
+			if (p.prescan)
+				count_elements(&p, buf);
+
+			res = parse_root(&p, buf, &doc->root) ? INDEX_OK : INDEX_FAILED;
+		}
+
+		if (res != INDEX_OK)
+			doc = NULL;
+	} else {
+		set_error(&p, JY_ERROR_MEMORY, buf);
+	}
+
+	/* Anything that fails without saying why has to be a syntax error */
+	if (!doc)
+		set_error(&p, JY_ERROR_SYNTAX, buf);
+
+	if (opts && opts->error)
+		report_error(opts->error, p.error, buf, p.error_at);
+
+#ifdef JAYCEON_STATS
+	finish_stats(&p, mark);
+#endif
+
+	if (p.counts)
+		p.allocator->free(p.allocator->user, p.counts);
+
+	if (p.stack != (char *) p.inline_stack)
+		p.allocator->free(p.allocator->user, p.stack);
+
+	if (!doc) {
+		if (owns_arena)
+			jy_arena_free(arena);
+		else
+			arena_rewind(arena, mark);
+	}
+
+	return doc;
+}
+
+/* Sets the parser up for the flags, to allocate from the arena if there is one */
+static void init_parser(Parser *p, const char *end, unsigned flags, int insitu, JYArena *arena, const JYAllocator *allocator) {
+	p->end = end;
+	select_scanners(p);
+	p->index = NULL;
+	p->counts = NULL;
+	p->insitu = insitu;
+	p->views = !insitu && (flags & JY_PARSE_STRING_VIEWS);
+	p->hash = (flags & JY_PARSE_HASH_KEYS) != 0;
+	p->lazy = (flags & JY_PARSE_LAZY) != 0;
+	p->utf8 = (flags & JY_PARSE_VALIDATE_UTF8) != 0;
+	p->depth = 0;
+	p->max_depth = JAYCEON_MAX_DEPTH;
+	p->error = JY_ERROR_NONE;
+	p->error_at = NULL;
+	/* Lazy subtrees are not parsed in the order the pre-scan counts them in */
+	p->prescan = !p->lazy && (flags & JY_PARSE_PRESCAN);
+	p->handler = NULL;
+	p->doc = NULL;
+	p->arena = arena;
+	p->keys = NULL;
+	p->allocator = allocator;
+	p->stack = (char *) p->inline_stack;
+	p->top = 0;
+	p->capacity = sizeof(p->inline_stack);
+#ifdef JAYCEON_STATS
+	p->stats = NULL;
+	p->counting = 0;
+	p->memory = 0;
+#endif
+}
+
+/* Keeps the first error, and the first position that comes with any of them */
+static void set_error(Parser *p, int code, const char *at) {
+	if (!p->error)
+		p->error = code;
+
+	if (!p->error_at)
+		p->error_at = at;
+}
+
+/* Fills in the error, at the position of at in the input starting at buf */
+static void report_error(JYError *error, int code, const char *buf, const char *at) {
+	error->code = code;
+	error->offset = 0;
+	error->line = 0;
+	error->column = 0;
+
+	if (code) {
+		error->line = 1;
+		error->column = 1;
+		count_position(error, buf, at ? at : buf);
+	}
+}
+
+/* Moves the position on over the characters up to end */
+static void count_position(JYError *pos, const char *string, const char *end) {
+	const char *eol;
+
+	pos->offset += (size_t) (end - string);
+
+	while ((eol = memchr(string, '\n', (size_t) (end - string)))) {
+		++pos->line;
+		pos->column = 1;
+		string = eol + 1;
+	}
+
+	pos->column += (size_t) (end - string);
+}
+
+int jy_parse_sax(const char *buf, size_t len, const JYHandler *handler, const JYAllocator *allocator) {
+	Parser p;
+	const char *end;
+
+	init_parser(&p, buf + len, 0, 0, NULL, allocator ? allocator : &default_allocator);
+	p.handler = handler;
+
+	end = end_root(&p, buf, sax_value(&p, buf));
+
+	if (p.stack != (char *) p.inline_stack)
+		p.allocator->free(p.allocator->user, p.stack);
+
+	return end != NULL;
+}
+
+/* Goes through the input like jy_parse_sax does, with nobody to report to */
+int jy_validate(const char *buf, size_t len, const JYParseOptions *opts) {
+	static const JYHandler handler = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+	Parser p;
+	const char *end;
+
+	init_parser(&p, buf + len, opts ? opts->flags & JY_PARSE_VALIDATE_UTF8 : 0, 0, NULL,
+		opts && opts->allocator ? opts->allocator : &default_allocator);
+	p.handler = &handler;
+	p.max_depth = opts && opts->max_depth ? opts->max_depth : JAYCEON_MAX_DEPTH;
+
+	if (!(end = end_root(&p, buf, sax_value(&p, buf))))
+		set_error(&p, JY_ERROR_SYNTAX, buf);
+
+	if (p.stack != (char *) p.inline_stack)
+		p.allocator->free(p.allocator->user, p.stack);
+
+	if (opts && opts->error)
+		report_error(opts->error, p.error, buf, p.error_at);
+
+	return end != NULL;
+}
+
+JYParser *jy_parser_new(const JYHandler *handler, const JYParseOptions *opts) {
+	JYParser *parser;
+	const JYAllocator *allocator;
+	JYArena *arena;
+
+	allocator = opts && opts->allocator ? opts->allocator : &default_allocator;
+
+	parser = allocator->alloc(allocator->user, sizeof(*parser));
+	if (!parser)
+		return NULL;
+
+	parser->allocator = *allocator;
+	parser->doc = NULL;
+	parser->owns_arena = 0;
+	arena = NULL;
+
+	if (!handler) {
+		if (opts && opts->arena) {
+			arena = opts->arena;
+		} else {
+			arena = jy_arena_new(NULL, 0, allocator);
+			parser->owns_arena = 1;
+		}
+
+		if (arena)
+			parser->doc = arena_alloc(arena, sizeof(*parser->doc));
+
+		if (!parser->doc) {
+			if (arena && parser->owns_arena)
+				jy_arena_free(arena);
+
+			allocator->free(allocator->user, parser);
+			return NULL;
+		}
+
+		parser->doc->arena = arena;
+		parser->doc->keys = opts ? opts->keys : NULL;
+		parser->doc->owns_arena = parser->owns_arena;
+		parser->doc->flags = 0;
+		parser->doc->insitu = 0;
+		parser->doc->file.data = NULL;
+		parser->doc->max_depth = opts && opts->max_depth ? opts->max_depth : JAYCEON_MAX_DEPTH;
+	}
+
+	init_parser(&parser->p, NULL, opts ? opts->flags & (JY_PARSE_HASH_KEYS | JY_PARSE_VALIDATE_UTF8) : 0, 0, arena, &parser->allocator);
+	parser->p.handler = handler;
+	parser->p.keys = parser->doc ? parser->doc->keys : NULL;
+	parser->p.max_depth = opts && opts->max_depth ? opts->max_depth : JAYCEON_MAX_DEPTH;
+
+	parser->frames = NULL;
+	parser->depth = 0;
+	parser->capacity = 0;
+	parser->token = NULL;
+	parser->length = 0;
+	parser->token_capacity = 0;
+	parser->lex = LEX_NONE;
+	parser->escape = 0;
+	parser->started = 0;
+	parser->status = PUSH_MORE;
+	parser->error = opts ? opts->error : NULL;
+	parser->pos.code = JY_ERROR_NONE;
+	parser->pos.offset = 0;
+	parser->pos.line = 1;
+	parser->pos.column = 1;
+	parser->token_pos = parser->pos;
+	parser->chunk = NULL;
+
+	if (parser->error)
+		report_error(parser->error, JY_ERROR_NONE, NULL, NULL);
+
+	return parser;
+}
+
+int jy_parser_feed(JYParser *parser, const char *chunk, size_t len) {
+	const char *string, *end;
+
+	string = chunk;
+	end = chunk + len;
+	parser->chunk = chunk;
+
+	if (parser->status != PUSH_MORE)
+		return parser->status != PUSH_FAILED;
+
+	while (parser->status == PUSH_MORE && string != end) {
+		char c;
+
+		c = *string;
+
+		if (parser->lex != LEX_NONE) {
+			string = push_token(parser, string, string, end);
+		} else if (!parser->started && (IS_SPACE(c) || c == '/')) {
+			/* Like jy_parse, the root has to start right at the beginning */
+			parser->status = PUSH_FAILED;
+			push_error(parser, &parser->pos, chunk, string);
+		} else if (IS_SPACE(c)) {
+			string = parser->p.skip_space(string + 1, end);
+		} else if (c && strchr("{}[]:,", c)) {
+			parser->started = 1;
+
+			if (!push_op(parser, c)) {
+				parser->status = PUSH_FAILED;
+				push_error(parser, &parser->pos, chunk, string);
+			}
+
+			++string;
+		} else {
+			parser->started = 1;
+			parser->lex = c == '\"' ? LEX_STRING : c == '/' ? LEX_SLASH : LEX_SCALAR;
+			parser->escape = 0;
+			string = push_token(parser, string, string + 1, end);
+		}
+	}
+
+	if (parser->error && parser->status != PUSH_FAILED)
+		count_position(&parser->pos, chunk, end);
+
+	return parser->status != PUSH_FAILED;
+}
+
+int jy_parser_done(JYParser *parser) {
+	return parser->status == PUSH_DONE;
+}
+
+JYDocument *jy_parser_document(JYParser *parser) {
+	JYDocument *doc;
+
+	if (parser->status != PUSH_DONE)
+		return NULL;
+
+	doc = parser->doc;
+	parser->doc = NULL;
+	return doc;
+}
+
+void jy_parser_free(JYParser *parser) {
+	JYAllocator allocator;
+
+	allocator = parser->allocator;
+
+	if (parser->doc && parser->owns_arena)
+		jy_arena_free(parser->doc->arena);
+
+	if (parser->frames)
+		allocator.free(allocator.user, parser->frames);
+
+	if (parser->token)
+		allocator.free(allocator.user, parser->token);
+
+	if (parser->p.stack != (char *) parser->p.inline_stack)
+		allocator.free(allocator.user, parser->p.stack);
+
+	allocator.free(allocator.user, parser);
+}
+
+JYRecords *jy_records_new(const char *buf, size_t len, const JYParseOptions *opts) {
+	JYRecords *records;
+	const JYAllocator *allocator;
+
+	allocator = opts && opts->allocator ? opts->allocator : &default_allocator;
+
+	records = allocator->alloc(allocator->user, sizeof(*records));
+	if (!records)
+		return NULL;
+
+	records->begin = buf;
+	records->start = buf;
+	records->next = buf;
+	records->end = buf + len;
+	records->line = 0;
+	records->lines = 0;
+	records->allocator = *allocator;
+
+	if (opts) {
+		records->opts = *opts;
+	} else {
+		records->opts.flags = 0;
+		records->opts.arena = NULL;
+		records->opts.keys = NULL;
+		records->opts.max_depth = 0;
+		records->opts.error = NULL;
+		records->opts.stats = NULL;
+	}
+
+	records->opts.allocator = &records->allocator;
+	records->owns_arena = 0;
+
+	if (!records->opts.arena) {
+		records->opts.arena = jy_arena_new(NULL, 0, allocator);
+		if (!records->opts.arena) {
+			allocator->free(allocator->user, records);
+			return NULL;
+		}
+
+		records->owns_arena = 1;
+	}
+
+	records->arena = records->opts.arena;
+	return records;
+}
+
+int jy_records_next(JYRecords *records, JYDocument **out) {
+	const char *string, *eol;
+
+	if (!(string = next_record(records, &eol)))
+		return 0;
+
+	jy_arena_reset(records->arena);
+	*out = parse_document(string, (size_t) (eol - string), &records->opts, 0);
+
+	if (!*out && records->opts.error) {
+		JYError *error;
+
+		error = records->opts.error;
+		error->offset += (size_t) (string - records->begin);
+		error->line = records->line;
+		error->column += (size_t) (string - records->start);
+	}
+
+	return 1;
+}
+
+size_t jy_records_line(JYRecords *records) {
+	return records->line;
+}
+
+int jy_records_parallel(const char *buf, size_t len, const JYParseOptions *opts, const JYParallelOptions *popts, JYRecordCallback callback, void *user) {
+	const JYAllocator *allocator;
+	const char *string, *end;
+	Worker *workers;
+	size_t chunk_size, line;
+	unsigned threads, i;
+	int res;
+
+	allocator = opts && opts->allocator ? opts->allocator : &default_allocator;
+	threads = popts && popts->threads ? popts->threads : 1;
+	chunk_size = popts && popts->chunk_size ? popts->chunk_size : JAYCEON_PARALLEL_CHUNK_SIZE;
+
+	/* Workers would add keys to the table at the same time */
+	if (opts && opts->keys && !opts->keys->frozen)
+		return 0;
+
+	workers = allocator->alloc(allocator->user, threads * sizeof(Worker));
+	if (!workers)
+		return 0;
+
+	res = 1;
+
+	for (i = 0; i < threads; ++i) {
+		Worker *w;
+
+		w = &workers[i];
+		w->records.allocator = popts && popts->allocators ? popts->allocators[i] : *allocator;
+
+		if (opts) {
+			w->records.opts = *opts;
+		} else {
+			w->records.opts.flags = 0;
+			w->records.opts.keys = NULL;
+			w->records.opts.max_depth = 0;
+		}
+
+		/* Workers would fill them in at the same time */
+		w->records.opts.error = NULL;
+		w->records.opts.stats = NULL;
+		w->records.opts.allocator = &w->records.allocator;
+		w->records.opts.arena = jy_arena_new(NULL, 0, &w->records.allocator);
+		w->records.arena = w->records.opts.arena;
+		w->records.owns_arena = 1;
+		w->results = NULL;
+		w->capacity = 0;
+
+		if (!w->records.arena)
+			res = 0;
+	}
+
+	string = buf;
+	end = buf + len;
+	line = 0;
+
+	while (res && string != end) {
+		unsigned active;
+
+		/* Slices end after a newline, which can never be inside of a string */
+		for (active = 0; active < threads && string != end; ++active) {
+			Worker *w;
+			const char *stop;
+
+			w = &workers[active];
+			stop = end;
+
+			if ((size_t) (end - string) > chunk_size) {
+				stop = memchr(string + chunk_size, '\n', (size_t) (end - string - chunk_size));
+				stop = stop ? stop + 1 : end;
+			}
+
+			w->records.next = string;
+			w->records.end = stop;
+			w->records.line = 0;
+			w->records.lines = 0;
+			w->count = 0;
+			w->failed = 0;
+			jy_arena_reset(w->records.arena);
+
+			string = stop;
+		}
+
+	#ifdef JAYCEON_PTHREADS
+		for (i = 1; i < active; ++i)
+			workers[i].joinable = !pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+
+		run_worker(&workers[0]);
+
+		/* A worker that did not get a thread of its own runs on this one */
+		for (i = 1; i < active; ++i) {
+			if (workers[i].joinable)
+				pthread_join(workers[i].thread, NULL);
+			else
+				run_worker(&workers[i]);
+		}
+	#else
+		for (i = 0; i < active; ++i)
+			run_worker(&workers[i]);
+	#endif
+
+		for (i = 0; i < active && res; ++i) {
+			Worker *w;
+			size_t j;
+
+			w = &workers[i];
+
+			if (w->failed)
+				res = 0;
+
+			for (j = 0; j < w->count && res; ++j)
+				res = callback(user, line + w->results[j].line, w->results[j].doc);
+
+			line += w->records.lines;
+		}
+	}
+
+	for (i = 0; i < threads; ++i) {
+		Worker *w;
+
+		w = &workers[i];
+
+		if (w->records.arena)
+			jy_arena_free(w->records.arena);
+
+		if (w->results)
+			w->records.allocator.free(w->records.allocator.user, w->results);
+	}
+
+	allocator->free(allocator->user, workers);
+	return res;
+}
+
+void jy_records_free(JYRecords *records) {
+	JYAllocator allocator;
+
+	allocator = records->allocator;
+
+	if (records->owns_arena)
+		jy_arena_free(records->arena);
+
+	allocator.free(allocator.user, records);
+}
+
+void jy_free(JYDocument *doc) {
+	if (doc->file.data)
+		close_file(&doc->file, &doc->arena->allocator);
+
+	if (doc->owns_arena)
+		jy_arena_free(doc->arena);
+}
+
+JYObject *jy_root(JYDocument *doc) {
+	JYObject *obj;
+
+	return jy_is_object(&doc->root, &obj) ? obj : NULL;
+}
+
+JYValue *jy_root_value(JYDocument *doc) {
+	return &doc->root;
+}
+
+JYArena *jy_arena_new(void *buffer, size_t size, const JYAllocator *allocator) {
+	JYArena *arena;
+	char *base;
+	const size_t OVERHEAD = ALIGN_UP(sizeof(JYArena)) + sizeof(Block);
+
+	if (!allocator)
+		allocator = &default_allocator;
+
+	if (buffer) {
+		size_t skew;
+
+		/* The arena is placed at the first aligned address of the buffer */
+		skew = (size_t) buffer % sizeof(Align);
+		if (skew) {
+			skew = sizeof(Align) - skew;
+
+			if (size < skew)
+				return NULL;
+
+			buffer = (char *) buffer + skew;
+			size -= skew;
+		}
+
+		if (size < OVERHEAD)
+			return NULL;
+
+		base = buffer;
+	} else {
+		if (size < OVERHEAD + JAYCEON_ARENA_BLOCK_SIZE)
+			size = OVERHEAD + JAYCEON_ARENA_BLOCK_SIZE;
+
+		base = allocator->alloc(allocator->user, size);
+		if (!base)
+			return NULL;
+	}
+
+	arena = (JYArena *) base;
+	arena->allocator = *allocator;
+
+	arena->first = (Block *) (base + ALIGN_UP(sizeof(JYArena)));
+	arena->first->header.next = NULL;
+	arena->first->header.size = (size - OVERHEAD) / sizeof(Align) * sizeof(Align);
+	arena->first->header.used = 0;
+	arena->current = arena->first;
+	arena->next_size = JAYCEON_ARENA_BLOCK_SIZE;
+	arena->owned = buffer == NULL;
+#ifdef JAYCEON_STATS
+	arena->allocs = buffer ? 0 : 1;
+	arena->allocated = buffer ? 0 : size;
+#endif
+
+	if (arena->next_size < arena->first->header.size * 2)
+		arena->next_size = arena->first->header.size * 2;
+
+	return arena;
+}
+
+void jy_arena_reset(JYArena *arena) {
+	Mark mark;
+
+	mark.block = arena->first;
+	mark.used = 0;
+
+	arena_rewind(arena, mark);
+}
+
+void jy_arena_free(JYArena *arena) {
+	Block *block;
+	JYAllocator allocator;
+
+	allocator = arena->allocator;
+	block = arena->first->header.next;
+
+	while (block) {
+		Block *next;
+
+		next = block->header.next;
+		allocator.free(allocator.user, block);
+		block = next;
+	}
+
+	if (arena->owned)
+		allocator.free(allocator.user, arena);
+}
+
+JYKeyTable *jy_keys_new(const JYAllocator *allocator) {
+	JYArena *arena;
+	JYKeyTable *table;
+
+	if (!(arena = jy_arena_new(NULL, 0, allocator)))
+		return NULL;
+
+	/* The table lives in its own arena, in front of the keys */
+	if (!(table = arena_alloc(arena, sizeof(*table)))) {
+		jy_arena_free(arena);
+		return NULL;
+	}
+
+	table->arena = arena;
+	table->slots = NULL;
+	table->mask = 0;
+	table->count = 0;
+	table->frozen = 0;
+
+	return table;
+}
+
+const char *jy_keys_intern(JYKeyTable *table, const char *key) {
+	return intern_key(table, key, strlen(key));
+}
+
+void jy_keys_freeze(JYKeyTable *table) {
+	table->frozen = 1;
+}
+
+void jy_keys_free(JYKeyTable *table) {
+	JYAllocator allocator;
+
+	allocator = table->arena->allocator;
+
+	if (table->slots)
+		allocator.free(allocator.user, table->slots);
+
+	jy_arena_free(table->arena);
+}
+
+JYValue *jy_index_s(JYObject *obj, const char *key) {
+	return find_value(obj, key, obj->val.hashed ? hash_key(key) : 0);
+}
+
+JYValue *jy_index_i(JYArray *obj, size_t key) {
+	if (key >= obj->val.length)
+		return NULL;
+
+	return &array_values(&obj->val)[key];
+}
+
+JYValue *jy_index_i_obj(JYObject *obj, size_t index, const char **out_key) {
+	if (!merge_pairs(&obj->val) || index >= obj->val.length)
+		return NULL;
+
+	if (obj->val.type == TYPE_SNAPSHOT_OBJECT) {
+		Entry *entry;
+
+		entry = (Entry *) SNAPSHOT_DATA(&obj->val) + index;
+		*out_key = (const char *) entry + entry->key;
+		return &entry->value;
+	}
+	
+	*out_key = (const char *) obj->val.value._pairs[index].key;
+	return &obj->val.value._pairs[index].value;
+}
+
+/* Sizes and iterators */
+size_t jy_array_len(JYArray *arr) {
+	return arr->val.length;
+}
+
+size_t jy_object_len(JYObject *obj) {
+	if (!merge_pairs(&obj->val))
+		return 0;
+
+	return obj->val.length;
+}
+
+void jy_array_iter(JYArray *arr, JYIterator *out) {
+	out->next = array_values(&arr->val);
+	out->end = (JYValue *) out->next + arr->val.length;
+	out->snapshot = 0;
+}
+
+JYValue *jy_array_next(JYIterator *it) {
+	JYValue *val;
+
+	if (it->next == it->end)
+		return NULL;
+
+	val = it->next;
+	it->next = val + 1;
+	return val;
+}
+
+int jy_object_iter(JYObject *obj, JYIterator *out) {
+	if (!merge_pairs(&obj->val))
+		return 0;
+
+	if (obj->val.type == TYPE_SNAPSHOT_OBJECT) {
+		out->next = SNAPSHOT_DATA(&obj->val);
+		out->end = (Entry *) out->next + obj->val.length;
+		out->snapshot = 1;
+		return 1;
+	}
+
+	out->next = obj->val.value._pairs;
+	out->end = obj->val.value._pairs + obj->val.length;
+	out->snapshot = 0;
+	return 1;
+}
+
+JYValue *jy_object_next(JYIterator *it, const char **out_key) {
+	Pair *pair;
+
+	if (it->next == it->end)
+		return NULL;
+
+	if (it->snapshot) {
+		Entry *entry;
+
+		entry = it->next;
+		it->next = entry + 1;
+
+		*out_key = (const char *) entry + entry->key;
+		return &entry->value;
+	}
+
+	pair = it->next;
+	it->next = pair + 1;
+
+	*out_key = (const char *) pair->key;
+	return &pair->value;
+}
+
+/* Type checks */
+int jy_is_null(JYValue *val) {
+	return val->type == TYPE_NULL;
+}
+
+int jy_is_bool(JYValue *val, int *out) {
+	if (val->type != TYPE_BOOL)
+		return 0;
+	
+	*out = val->value._bool;
+	return 1;
+}
+
+int jy_is_number(JYValue *val, double *out) {
+	if (val->type == TYPE_INTEGER) {
+		*out = (double) val->value._integer;
+		return 1;
+	}
+
+	if (val->type != TYPE_NUMBER)
+		return 0;
+	
+	*out = val->value._number;
+	return 1;
+}
+
+int jy_is_int64(JYValue *val, JYInt64 *out) {
+	double limit, num;
+
+	if (val->type == TYPE_INTEGER) {
+		*out = val->value._integer;
+		return 1;
+	}
+
+	if (val->type != TYPE_NUMBER)
+		return 0;
+
+	/* Two to the power of the bits of JYInt64 without the sign bit */
+	limit = (double) (~(UInt64) 0 >> 1) + 1.0;
+	num = val->value._number;
+
+	if (!(num >= -limit && num < limit) || num != (double) (JYInt64) num)
+		return 0;
+
+	*out = (JYInt64) num;
+	return 1;
+}
+
+int jy_is_string(JYValue *val, const char **out) {
+	if (val->type == TYPE_VIEW || val->type == TYPE_ESCAPED_VIEW) {
+		View *view;
+		char *chars;
+		size_t len;
+
+		view = val->value._view;
+		len = val->length;
+
+		chars = arena_alloc(view->arena, len + 1);
+		if (!chars)
+			return 0;
+
+		if (val->type == TYPE_ESCAPED_VIEW) {
+			len = decode_string(view->chars, view->chars + len, chars);
+			arena_shrink(view->arena, chars, (size_t) val->length + 1, len + 1);
+		} else {
+			memcpy(chars, view->chars, len);
+		}
+
+		chars[len] = '\0';
+
+		val->type = TYPE_STRING;
+		val->value._string = chars;
+		val->length = (Index) len;
+	}
+
+	if (val->type == TYPE_SNAPSHOT_STRING) {
+		*out = SNAPSHOT_DATA(val);
+		return 1;
+	}
+
+	if (val->type != TYPE_STRING)
+		return 0;
+	
+	*out = (const char *) val->value._string;
+	return 1;
+}
+
+int jy_is_string_n(JYValue *val, const char **out, size_t *out_len) {
+	const char *chars;
+
+	if (val->type == TYPE_VIEW) {
+		*out = val->value._view->chars;
+		*out_len = val->length;
+		return 1;
+	}
+
+	if (!jy_is_string(val, &chars))
+		return 0;
+
+	*out = chars;
+	*out_len = val->length;
+	return 1;
+}
+
+int jy_is_array(JYValue *val, JYArray **out) {
+	if (val->type == TYPE_NODE)
+		val = val->value._node;
+
+	if (val->type == TYPE_LAZY_ARRAY && !parse_lazy(val))
+		return 0;
+
+	if (val->type != TYPE_ARRAY && val->type != TYPE_SNAPSHOT_ARRAY)
+		return 0;
+	
+	*out = (JYArray *) val;
+	return 1;
+}
+
+int jy_is_object(JYValue *val, JYObject **out) {
+	if (val->type == TYPE_NODE)
+		val = val->value._node;
+
+	if (val->type == TYPE_LAZY_OBJECT && !parse_lazy(val))
+		return 0;
+
+	if (val->type != TYPE_OBJECT && val->type != TYPE_SNAPSHOT_OBJECT)
+		return 0;
+	
+	*out = (JYObject *) val;
+	return 1;
+}
+
+JYDocument *jy_new(const JYParseOptions *opts) {
+	JYDocument *doc;
+	JYArena *arena;
+
+	if (opts && opts->arena) {
+		arena = opts->arena;
+	} else {
+		arena = jy_arena_new(NULL, 0, opts ? opts->allocator : NULL);
+		if (!arena)
+			return NULL;
+	}
+
+	doc = arena_alloc(arena, sizeof(*doc));
+	if (!doc) {
+		if (!(opts && opts->arena))
+			jy_arena_free(arena);
+
+		return NULL;
+	}
+
+	doc->root.type = TYPE_OBJECT;
+	doc->root.value._pairs = NULL;
+	doc->root.length = 0;
+	doc->root.hashed = 0;
+	doc->root.growable = 0;
+	doc->arena = arena;
+	doc->keys = opts ? opts->keys : NULL;
+	doc->owns_arena = !(opts && opts->arena);
+	doc->flags = 0;
+	doc->insitu = 0;
+	doc->file.data = NULL;
+	doc->max_depth = opts && opts->max_depth ? opts->max_depth : JAYCEON_MAX_DEPTH;
+
+	return doc;
+}
+
+JYValue *jy_array_append(JYDocument *doc, JYArray *arr) {
+	return jy_array_insert(doc, arr, arr->val.length);
+}
+
+JYValue *jy_array_insert(JYDocument *doc, JYArray *arr, size_t index) {
+	JYValue *values;
+
+	/* Snapshots cannot be changed */
+	if (arr->val.type == TYPE_SNAPSHOT_ARRAY)
+		return NULL;
+
+	if (index > arr->val.length || !reserve_element(doc, &arr->val, sizeof(JYValue)))
+		return NULL;
+
+	values = arr->val.value._values;
+	memmove(values + index + 1, values + index, (arr->val.length - index) * sizeof(JYValue));
+	++arr->val.length;
+
+	jy_set_null(&values[index]);
+	return &values[index];
+}
+
+/*
+ * Keys that are not in the object yet are added past its sorted pairs, to be
+ * sorted and merged in all at once when the object is next looked into
+ */
+JYValue *jy_object_set(JYDocument *doc, JYObject *obj, const char *key) {
+	Growth *growth;
+	Pair *pair;
+	Index *slot;
+	char *chars;
+	size_t len;
+	unsigned long hash;
+
+	if (obj->val.type == TYPE_SNAPSHOT_OBJECT)
+		return NULL;
+
+	growth = get_growth(&obj->val);
+
+	if ((pair = find_pair(obj->val.value._pairs, growth ? growth->sorted : obj->val.length, key)))
+		return &pair->value;
+
+	/* Keys added since the pairs were last merged are not sorted in yet */
+	hash = hash_key(key);
+
+	if (growth && growth->added && *(slot = find_added(growth, obj->val.value._pairs, key, hash)))
+		return &obj->val.value._pairs[*slot - 1].value;
+
+	len = strlen(key);
+
+	if (!doc->keys || !(chars = (char *) intern_key(doc->keys, key, len))) {
+		chars = arena_alloc(doc->arena, len + 1);
+		if (!chars)
+			return NULL;
+
+		memcpy(chars, key, len + 1);
+	}
+
+	if (!reserve_element(doc, &obj->val, sizeof(Pair)))
+		return NULL;
+
+	growth = get_growth(&obj->val);
+	if (!reserve_added(doc, growth, obj->val.value._pairs, obj->val.length))
+		return NULL;
+
+	pair = &obj->val.value._pairs[obj->val.length++];
+	pair->key = chars;
+	*find_added(growth, obj->val.value._pairs, chars, hash) = obj->val.length;
+
+	jy_set_null(&pair->value);
+	return &pair->value;
+}
+
+void jy_set_null(JYValue *val) {
+	val->type = TYPE_NULL;
+}
+
+void jy_set_bool(JYValue *val, int b) {
+	val->type = TYPE_BOOL;
+	val->value._bool = !!b;
+}
+
+void jy_set_number(JYValue *val, double num) {
+	val->type = TYPE_NUMBER;
+	val->value._number = num;
+}
+
+void jy_set_int64(JYValue *val, JYInt64 num) {
+	val->type = TYPE_INTEGER;
+	val->value._integer = num;
+}
+
+int jy_set_string(JYDocument *doc, JYValue *val, const char *str) {
+	return jy_set_string_n(doc, val, str, strlen(str));
+}
+
+int jy_set_string_n(JYDocument *doc, JYValue *val, const char *str, size_t len) {
+	char *chars;
+
+	if (len > INDEX_MAX || !(chars = arena_alloc(doc->arena, len + 1)))
+		return 0;
+
+	memcpy(chars, str, len);
+	chars[len] = '\0';
+
+	val->type = TYPE_STRING;
+	val->value._string = chars;
+	val->length = (Index) len;
+	return 1;
+}
+
+JYArray *jy_set_array(JYDocument *doc, JYValue *val) {
+	return (JYArray *) new_node(doc, val, TYPE_ARRAY);
+}
+
+JYObject *jy_set_object(JYDocument *doc, JYValue *val) {
+	return (JYObject *) new_node(doc, val, TYPE_OBJECT);
+}
+
+JYPath *jy_path_compile(const char *pointer, const JYAllocator *allocator) {
+	JYPath *path;
+	const char *c;
+	char *key;
+	size_t count, i;
+
+	if (!allocator)
+		allocator = &default_allocator;
+
+	if (*pointer && *pointer != '/')
+		return NULL;
+
+	for (count = 0, c = pointer; *c; ++c)
+		count += *c == '/';
+
+	path = allocator->alloc(allocator->user, ALIGN_UP(sizeof(JYPath)) + count * sizeof(Step) + strlen(pointer) + 1);
+	if (!path)
+		return NULL;
+
+	path->allocator = *allocator;
+	path->steps = (Step *) ((char *) path + ALIGN_UP(sizeof(JYPath)));
+	path->count = count;
+
+	key = (char *) (path->steps + count);
+
+	for (i = 0, c = pointer; i < count; ++i) {
+		Step *step;
+
+		step = &path->steps[i];
+		step->key = key;
+
+		/* Of the escape sequences, ~1 stands for a slash and ~0 for a tilde */
+		for (++c; *c && *c != '/'; ++c) {
+			if (*c == '~') {
+				if (c[1] != '0' && c[1] != '1') {
+					allocator->free(allocator->user, path);
+					return NULL;
+				}
+
+				*key++ = c[1] == '0' ? '~' : '/';
+				++c;
+			} else {
+				*key++ = *c;
+			}
+		}
+
+		*key++ = '\0';
+
+		step->length = (size_t) (key - step->key - 1);
+		step->hash = hash_key(step->key);
+		step->index = (size_t) -1;
+
+		/* Indices have no leading zeros, except for zero itself */
+		if (step->length && (step->key[0] != '0' || step->length == 1)) {
+			size_t index, j;
+
+			index = 0;
+
+			for (j = 0; j < step->length && IS_DIGIT(step->key[j]); ++j) {
+				if (index > ((size_t) -2 - (step->key[j] - '0')) / 10)
+					break;
+
+				index = index * 10 + (size_t) (step->key[j] - '0');
+			}
+
+			if (j == step->length)
+				step->index = index;
+		}
+	}
+
+	return path;
+}
+
+JYValue *jy_path_get(const JYPath *path, JYDocument *doc) {
+	JYValue *val;
+	size_t i;
+
+	val = &doc->root;
+
+	for (i = 0; i < path->count && val; ++i) {
+		const Step *step;
+		JYArray *arr;
+		JYObject *obj;
+
+		step = &path->steps[i];
+
+		if (jy_is_object(val, &obj))
+			val = find_value(obj, step->key, step->hash);
+		else if (jy_is_array(val, &arr))
+			val = jy_index_i(arr, step->index);
+		else
+			val = NULL;
+	}
+
+	return val;
+}
+
+JYDocument *jy_path_parse(const JYPath *path, const char *buf, size_t len, const JYParseOptions *opts, JYValue **out) {
+	JYDocument *doc;
+	JYValue *val;
+	Parser p;
+	Mark mark;
+	unsigned flags;
+	int res;
+
+	if (opts && opts->arena)
+		mark = arena_mark(opts->arena);
+
+	if (!(doc = jy_new(opts))) {
+		if (opts && opts->error)
+			report_error(opts->error, JY_ERROR_MEMORY, buf, buf);
+
+		return NULL;
+	}
+
+	flags = opts ? opts->flags : 0;
+	init_parser(&p, buf + len, flags, 0, doc->arena, &doc->arena->allocator);
+
+	doc->flags = flags;
+	p.doc = doc;
+	p.keys = doc->keys;
+	p.max_depth = doc->max_depth;
+
+	/* The counts are taken of whole documents, not of values inside them */
+	p.prescan = 0;
+
+	val = parser_alloc(&p, sizeof(JYValue));
+	res = val && find_path(&p, buf, path, val);
+
+	if (p.stack != (char *) p.inline_stack)
+		p.allocator->free(p.allocator->user, p.stack);
+
+	if (!res)
+		set_error(&p, JY_ERROR_SYNTAX, buf);
+
+	if (opts && opts->error)
+		report_error(opts->error, p.error, buf, p.error_at);
+
+	if (!res) {
+		if (doc->owns_arena)
+			jy_free(doc);
+		else
+			arena_rewind(opts->arena, mark);
+
+		return NULL;
+	}
+
+	*out = val;
+	return doc;
+}
+
+void jy_path_free(JYPath *path) {
+	JYAllocator allocator;
+
+	allocator = path->allocator;
+	allocator.free(allocator.user, path);
+}
+
+int jy_extract(const char *buf, size_t len, const JYField *fields, size_t count, void *out, const JYParseOptions *opts) {
+	return extract(buf, len, fields, count, out, opts, 0);
+}
+
+int jy_extract_insitu(char *buf, size_t len, const JYField *fields, size_t count, void *out, const JYParseOptions *opts) {
+	return extract(buf, len, fields, count, out, opts, 1);
+}
+
+int jy_write(JYDocument *doc, unsigned flags, JYWriteCallback callback, void *user) {
+	char buf[JAYCEON_WRITE_BUFFER_SIZE];
+	Writer w;
+
+	w.callback = callback;
+	w.user = user;
+	w.allocator = NULL;
+	w.buf = buf;
+	w.capacity = sizeof(buf);
+	w.flags = flags;
+
+	return write_document(&w, doc);
+}
+
+char *jy_write_string(JYDocument *doc, unsigned flags, size_t *out_len, const JYAllocator *allocator) {
+	Writer w;
+
+	if (!allocator)
+		allocator = &default_allocator;
+
+	w.callback = NULL;
+	w.user = NULL;
+	w.allocator = allocator;
+	w.buf = NULL;
+	w.capacity = 0;
+	w.flags = flags;
+
+	/* The terminator is not part of the output, but has to be there */
+	if (write_document(&w, doc))
+		write_bytes(&w, "", 1);
+
+	if (w.failed) {
+		if (w.buf)
+			allocator->free(allocator->user, w.buf);
+
+		return NULL;
+	}
+
+	if (out_len)
+		*out_len = w.length - 1;
+
+	return w.buf;
+}
+
+#ifndef NDEBUG
+void jy_print(JYDocument *doc) {
+	jy_write(doc, 0, print_chunk, stdout);
+	printf("\n");
+}
+#endif /* NDEBUG */
+
+void *jy_snapshot_write(JYDocument *doc, size_t *out_size, const JYAllocator *allocator) {
+	SnapshotHeader *header;
+	Snapshot s;
+	size_t size, i;
+
+	if (!allocator)
+		allocator = &default_allocator;
+
+	s.allocator = allocator;
+	s.buf = NULL;
+	s.length = ALIGN_UP(sizeof(SnapshotHeader));
+	s.slots = NULL;
+	s.mask = 0;
+	s.count = 0;
+	s.key_bytes = 0;
+	s.failed = 0;
+
+	measure_value(&s, &doc->root);
+	size = s.length + s.key_bytes;
+
+	if (!s.failed && !(s.buf = allocator->alloc(allocator->user, size)))
+		s.failed = 1;
+
+	if (!s.failed) {
+		/* Padding is zeroed too, so the same document always gives the same bytes */
+		memset(s.buf, 0, size);
+
+		header = (SnapshotHeader *) s.buf;
+		memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+		header->order = SNAPSHOT_ORDER;
+		header->layout = SNAPSHOT_LAYOUT;
+		header->size = size;
+
+		s.keys = s.length;
+		s.length = ALIGN_UP(sizeof(SnapshotHeader));
+		copy_value(&s, &header->root, &doc->root);
+
+		for (i = 0; s.slots && i <= s.mask; ++i)
+			if (s.slots[i].chars)
+				memcpy(s.buf + s.keys + s.slots[i].offset, s.slots[i].chars, s.slots[i].length + 1);
+	}
+
+	if (s.slots)
+		allocator->free(allocator->user, s.slots);
+
+	if (s.failed) {
+		if (s.buf)
+			allocator->free(allocator->user, s.buf);
+
+		return NULL;
+	}
+
+	if (out_size)
+		*out_size = size;
+
+	return s.buf;
+}
+
+JYDocument *jy_snapshot_load(const void *buf, size_t len, const JYParseOptions *opts) {
+	const SnapshotHeader *header;
+	JYDocument *doc;
+	JYValue *root;
+
+	header = buf;
+
+	if ((size_t) buf % sizeof(Align) || len < sizeof(*header) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))
+		|| header->order != SNAPSHOT_ORDER || header->layout != SNAPSHOT_LAYOUT || header->size > len) {
+		if (opts && opts->error)
+			report_error(opts->error, JY_ERROR_SYNTAX, "", "");
+
+		return NULL;
+	}
+
+	if (!(doc = jy_new(opts))) {
+		if (opts && opts->error)
+			report_error(opts->error, JY_ERROR_MEMORY, "", "");
+
+		return NULL;
+	}
+
+	if (opts && opts->error)
+		report_error(opts->error, JY_ERROR_NONE, NULL, NULL);
+
+	/* The root refers to its contents from where it is, so it stays there */
+	root = (JYValue *) &header->root;
+
+	if (root->type == TYPE_SNAPSHOT_ARRAY || root->type == TYPE_SNAPSHOT_OBJECT) {
+		doc->root.type = TYPE_NODE;
+		doc->root.value._node = root;
+	} else if (root->type == TYPE_SNAPSHOT_STRING) {
+		doc->root.type = TYPE_STRING;
+		doc->root.value._string = SNAPSHOT_DATA(root);
+		doc->root.length = root->length;
+	} else {
+		doc->root = *root;
+	}
+
+	return doc;
+}
+
+JYDocument *jy_snapshot_load_file(const char *path, const JYParseOptions *opts) {
+	const JYAllocator *allocator;
+	JYDocument *doc;
+	File file;
+
+	allocator = file_allocator(opts);
+
+	if (!open_file(&file, path, allocator)) {
+		if (opts && opts->error)
+			report_error(opts->error, JY_ERROR_IO, "", "");
+
+		return NULL;
+	}
+
+	if ((doc = jy_snapshot_load(file.data, file.size, opts)))
+		keep_file(doc, &file);
+	else
+		close_file(&file, allocator);
+
+	return doc;
+}
+
+/*
+ * Follows the path through the input, only looking at the keys and values it
+ * passes, and parses the value at its end. Everything it skips is checked as
+ * little as lazy documents check their subtrees, and nothing past the value
+ * is looked at.
+ */
+static const char *find_path(Parser *p, const char *string, const JYPath *path, JYValue *out) {
+	size_t i;
+
+	for (i = 0; i < path->count && string; ++i) {
+		if (PEEK(p, string) == '{') {
+			string = find_key(p, string, &path->steps[i]);
+		} else if (PEEK(p, string) == '[') {
+			string = find_index(p, string, path->steps[i].index);
+		} else {
+			/* Scalars have nothing to step into, if they are valid at all */
+			if (skip_value(p, string))
+				set_error(p, JY_ERROR_NOT_FOUND, string);
+
+			return NULL;
+		}
+	}
+
+	return string ? parse_value(p, string, out) : NULL;
+}
+
+/* Returns where the value of the key starts, of the first pair that has it */
+static const char *find_key(Parser *p, const char *string, const Step *step) {
+	string = parse_space(p, string + 1);
+
+	while (PEEK(p, string) == '\"') {
+		const char *end;
+		size_t base;
+		int escaped, match;
+
+		++string;
+
+		if (!(end = scan_string(p, string, &escaped)))
+			return NULL;
+
+		if (escaped) {
+			char *buf;
+			size_t len;
+
+			base = p->top;
+
+			if (!(buf = stack_push(p, NULL, (size_t) (end - string))))
+				return NULL;
+
+			len = decode_string(string, end, buf);
+			match = len == step->length && !memcmp(buf, step->key, len);
+
+			p->top = base;
+		} else {
+			match = (size_t) (end - string) == step->length && !memcmp(string, step->key, step->length);
+		}
+
+		string = parse_space(p, end + 1);
+
+		if (PEEK(p, string) != ':') {
+			set_error(p, JY_ERROR_SYNTAX, string);
+			return NULL;
+		}
+
+		string = parse_space(p, string + 1);
+
+		if (match)
+			return string;
+
+		if (!(string = skip_value(p, string)))
+			return NULL;
+
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) != ',')
+			break;
+
+		string = parse_space(p, string + 1);
+	}
+
+	/* Only the end of the object means that the key is not there */
+	set_error(p, PEEK(p, string) == '}' ? JY_ERROR_NOT_FOUND : JY_ERROR_SYNTAX, string);
+	return NULL;
+}
+
+/* Returns where the value at the index of the array starts */
+static const char *find_index(Parser *p, const char *string, size_t index) {
+	size_t i;
+
+	string = parse_space(p, string + 1);
+
+	for (i = 0; PEEK(p, string) != ']' && PEEK(p, string) != '\0'; ++i) {
+		if (i == index)
+			return string;
+
+		if (!(string = skip_value(p, string)))
+			return NULL;
+
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) != ',')
+			break;
+
+		string = parse_space(p, string + 1);
+	}
+
+	set_error(p, PEEK(p, string) == ']' ? JY_ERROR_NOT_FOUND : JY_ERROR_SYNTAX, string);
+	return NULL;
+}
+
+static const char *skip_value(Parser *p, const char *string) {
+	JYValue val;
+	int escaped;
+
+	switch (PEEK(p, string)) {
+		case '[':
+		case '{':
+			return skip_container(p, string);
+
+		case '\"':
+			string = scan_string(p, string + 1, &escaped);
+			return string ? string + 1 : NULL;
+
+		default:
+			return parse_scalar(p, string, &val);
+	}
+}
+
+/* Nothing but strings is allocated from the arena of the options */
+static int extract(const char *buf, size_t len, const JYField *fields, size_t count, void *out, const JYParseOptions *opts, int insitu) {
+	JYArena *arena;
+	Parser p;
+	Mark mark;
+	int res;
+
+	arena = opts ? opts->arena : NULL;
+
+	if (arena)
+		mark = arena_mark(arena);
+
+	init_parser(&p, buf + len, opts ? opts->flags & JY_PARSE_VALIDATE_UTF8 : 0, insitu, arena,
+		opts && opts->allocator ? opts->allocator : &default_allocator);
+
+	p.max_depth = opts && opts->max_depth ? opts->max_depth : JAYCEON_MAX_DEPTH;
+	res = extract_fields(&p, buf, fields, count, out) != NULL;
+
+	if (p.stack != (char *) p.inline_stack)
+		p.allocator->free(p.allocator->user, p.stack);
+
+	if (!res)
+		set_error(&p, JY_ERROR_SYNTAX, buf);
+
+	if (opts && opts->error)
+		report_error(opts->error, p.error, buf, p.error_at);
+
+	if (!res && arena)
+		arena_rewind(arena, mark);
+
+	return res;
+}
+
+/*
+ * Goes through the pairs of the object, looking every key up among the fields.
+ * Which fields were found is kept on the stack, one byte each, which is 1 for
+ * a null and 2 for a value.
+ */
+static const char *extract_fields(Parser *p, const char *string, const JYField *fields, size_t count, void *out) {
+	size_t next, i;
+
+	if (PEEK(p, string) != '{') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	if (!stack_push(p, NULL, count))
+		return NULL;
+
+	memset(p->stack, 0, count);
+	p->depth = 1;
+	next = 0;
+
+	string = parse_space(p, string + 1);
+
+	while (PEEK(p, string) == '\"') {
+		const char *end, *key;
+		size_t len, base;
+		int escaped;
+
+		++string;
+
+		if (!(end = scan_string(p, string, &escaped)))
+			return NULL;
+
+		key = string;
+		len = (size_t) (end - string);
+		base = p->top;
+
+		if (escaped) {
+			char *buf;
+
+			if (!(buf = stack_push(p, NULL, len)))
+				return NULL;
+
+			key = buf;
+			len = decode_string(string, end, buf);
+		}
+
+		/* Keys with a NUL in them cannot be any of the names */
+		i = escaped && memchr(key, '\0', len) ? count : find_field(fields, count, next, key, len);
+
+		p->top = base;
+
+		if (i < count && p->stack[i]) {
+			set_error(p, JY_ERROR_DUPLICATE_KEY, string - 1);
+			return NULL;
+		}
+
+		string = parse_space(p, end + 1);
+
+		if (PEEK(p, string) != ':') {
+			set_error(p, JY_ERROR_SYNTAX, string);
+			return NULL;
+		}
+
+		string = parse_space(p, string + 1);
+
+		if (i < count) {
+			next = i + 1;
+
+			/* Null does not count as a value, but still as the key */
+			if (PEEK(p, string) == 'n') {
+				string = parse_null(p, string);
+				p->stack[i] = 1;
+			} else {
+				string = extract_value(p, string, &fields[i], out);
+				p->stack[i] = 2;
+			}
+		} else {
+			string = skip_value(p, string);
+		}
+
+		if (!string)
+			return NULL;
+
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) != ',')
+			break;
+
+		string = parse_space(p, string + 1);
+	}
+
+	if (PEEK(p, string) != '}') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	for (i = 0; i < count; ++i) {
+		if (fields[i].required && p->stack[i] != 2) {
+			set_error(p, JY_ERROR_NOT_FOUND, string);
+			return NULL;
+		}
+	}
+
+	return string + 1;
+}
+
+/*
+ * Fields usually come in the order of the table, so the search starts past the
+ * last one found, which makes it one comparison per key
+ */
+static size_t find_field(const JYField *fields, size_t count, size_t next, const char *key, size_t len) {
+	size_t i, j;
+
+	for (i = 0; i < count; ++i) {
+		j = (next + i) % count;
+
+		if (!strncmp(fields[j].name, key, len) && !fields[j].name[len])
+			return j;
+	}
+
+	return count;
+}
+
+/* Parses the value into the member of the field, if it is of the right type */
+static const char *extract_value(Parser *p, const char *string, const JYField *field, void *out) {
+	JYValue val;
+	const char *end, *str;
+	char *member;
+	char c;
+	int ok;
+
+	member = (char *) out + field->offset;
+	c = PEEK(p, string);
+
+	if (field->type == JY_FIELD_BOOL)
+		ok = c == 't' || c == 'f';
+	else if (field->type == JY_FIELD_NUMBER || field->type == JY_FIELD_INT64)
+		ok = c == '-' || IS_DIGIT(c);
+	else
+		ok = field->type == JY_FIELD_STRING && c == '\"';
+
+	if (!ok) {
+		/* Anything that cannot start a value at all is not a matter of types */
+		set_error(p, c && strchr("[{\"tf-0123456789", c) ? JY_ERROR_TYPE : JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	if (c == '\"' && !p->insitu && !p->arena) {
+		set_error(p, JY_ERROR_MEMORY, string);
+		return NULL;
+	}
+
+	if (!(end = parse_scalar(p, string, &val)))
+		return NULL;
+
+	if (field->type == JY_FIELD_BOOL)
+		*(int *) member = val.value._bool;
+	else if (field->type == JY_FIELD_NUMBER)
+		ok = jy_is_number(&val, (double *) member);
+	else if (field->type == JY_FIELD_INT64)
+		ok = jy_is_int64(&val, (JYInt64 *) member);
+	else if (jy_is_string(&val, &str))
+		*(const char **) member = str;
+
+	if (!ok) {
+		set_error(p, JY_ERROR_TYPE, string);
+		return NULL;
+	}
+
+	return end;
+}
+
+/* Writes the root value, and whatever is left in the buffer */
+static int write_document(Writer *w, JYDocument *doc) {
+	Parser p;
+
+	select_scanners(&p);
+
+	w->scan_plain = p.scan_plain;
+	w->length = 0;
+	w->depth = 0;
+	w->failed = 0;
+
+	write_value(w, &doc->root);
+
+	if (!w->failed && w->callback && w->length && !w->callback(w->user, w->buf, w->length))
+		w->failed = 1;
+
+	return !w->failed;
+}
+
+static void write_bytes(Writer *w, const char *data, size_t len) {
+	if (w->failed)
+		return;
+
+	if (w->capacity - w->length < len) {
+		if (w->callback) {
+			if (w->length && !w->callback(w->user, w->buf, w->length)) {
+				w->failed = 1;
+				return;
+			}
+
+			w->length = 0;
+
+			/* What does not fit into the buffer at all goes straight through */
+			if (len > w->capacity) {
+				w->failed = !w->callback(w->user, data, len);
+				return;
+			}
+		} else {
+			size_t newcap;
+			char *newbuf;
+
+			newcap = w->capacity ? w->capacity * 2 : JAYCEON_WRITE_BUFFER_SIZE;
+			while (newcap - w->length < len)
+				newcap *= 2;
+
+			newbuf = w->allocator->alloc(w->allocator->user, newcap);
+			if (!newbuf) {
+				w->failed = 1;
+				return;
+			}
+
+			if (w->buf) {
+				memcpy(newbuf, w->buf, w->length);
+				w->allocator->free(w->allocator->user, w->buf);
+			}
+
+			w->buf = newbuf;
+			w->capacity = newcap;
+		}
+	}
+
+	memcpy(w->buf + w->length, data, len);
+	w->length += len;
+}
+
+/* Starts a new line at the current depth, when pretty printing */
+static void write_indent(Writer *w) {
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+	size_t depth;
+
+	if (!(w->flags & JY_WRITE_PRETTY))
+		return;
+
+	write_bytes(w, "\n", 1);
+
+	for (depth = w->depth; depth > sizeof(tabs) - 1; depth -= sizeof(tabs) - 1)
+		write_bytes(w, tabs, sizeof(tabs) - 1);
+
+	write_bytes(w, tabs, depth);
+}
+
+static void write_value(Writer *w, JYValue *val) {
+	JYArray *arr;
+	JYObject *obj;
+	const char *str;
+	size_t len;
+
+	if (val->type == TYPE_NULL)
+		write_bytes(w, "null", 4);
+	else if (val->type == TYPE_BOOL)
+		write_bytes(w, val->value._bool ? "true" : "false", val->value._bool ? 4 : 5);
+	else if (val->type == TYPE_NUMBER)
+		write_number(w, val->value._number);
+	else if (val->type == TYPE_INTEGER)
+		write_integer(w, val->value._integer);
+	else if (jy_is_string_n(val, &str, &len))
+		write_string(w, str, len);
+	else if (jy_is_array(val, &arr))
+		write_array(w, arr);
+	else if (jy_is_object(val, &obj))
+		write_object(w, obj);
+	else
+		/* A string view or lazy subtree which could not be parsed */
+		w->failed = 1;
+}
+
+static void write_array(Writer *w, JYArray *arr) {
+	JYValue *values;
+	size_t count, i;
+
+	values = array_values(&arr->val);
+	count = arr->val.length;
+
+	write_bytes(w, "[", 1);
+	++w->depth;
+
+	for (i = 0; i < count && !w->failed; ++i) {
+		if (i)
+			write_bytes(w, ",", 1);
+
+		write_indent(w);
+		write_value(w, &values[i]);
+	}
+
+	--w->depth;
+	if (count)
+		write_indent(w);
+
+	write_bytes(w, "]", 1);
+}
+
+static void write_object(Writer *w, JYObject *obj) {
+	JYIterator it;
+	JYValue *val;
+	const char *key;
+	size_t count, i;
+
+	if (!jy_object_iter(obj, &it)) {
+		w->failed = 1;
+		return;
+	}
+
+	count = obj->val.length;
+
+	write_bytes(w, "{", 1);
+	++w->depth;
+
+	for (i = 0; !w->failed && (val = jy_object_next(&it, &key)); ++i) {
+		if (i)
+			write_bytes(w, ",", 1);
+
+		/* Parsing rejects keys with a NUL in them, so none is cut short here */
+		write_indent(w);
+		write_string(w, key, strlen(key));
+		write_bytes(w, ": ", w->flags & JY_WRITE_PRETTY ? 2 : 1);
+		write_value(w, val);
+	}
+
+	--w->depth;
+	if (count)
+		write_indent(w);
+
+	write_bytes(w, "}", 1);
+}
+
+/* Runs without anything to escape are written as they are, found by the scanner */
+static void write_string(Writer *w, const char *str, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	const char *end, *plain;
+
+	end = str + len;
+
+	write_bytes(w, "\"", 1);
+
+	while (str != end) {
+		char escape[6];
+		unsigned char c;
+
+		plain = w->scan_plain(str, end);
+		write_bytes(w, str, (size_t) (plain - str));
+
+		if (plain == end)
+			break;
+
+		c = (unsigned char) *plain;
+		escape[0] = '\\';
+		escape[1] = (char) c;
+
+		if (c == '\n')
+			escape[1] = 'n';
+		else if (c == '\r')
+			escape[1] = 'r';
+		else if (c == '\b')
+			escape[1] = 'b';
+		else if (c == '\f')
+			escape[1] = 'f';
+		else if (c == '\t')
+			escape[1] = 't';
+
+		if (c < 0x20 && escape[1] == (char) c) {
+			escape[1] = 'u';
+			escape[2] = '0';
+			escape[3] = '0';
+			escape[4] = hex[c >> 4];
+			escape[5] = hex[c & 0xF];
+			write_bytes(w, escape, 6);
+		} else {
+			write_bytes(w, escape, 2);
+		}
+
+		str = plain + 1;
+	}
+
+	write_bytes(w, "\"", 1);
+}
+
+/*
+ * Finds the fewest digits that read back as the same double. Most numbers have
+ * a mantissa of at most 53 bits and 22 decimals, like a number that parsing
+ * takes the fast path for, which is then found the same way in reverse. Others
+ * go through sprintf with 15 to 17 significant digits: 17 always read back the
+ * same, and if fewer than 15 do, rounding to 15 ends in zeros which %g drops.
+ * Numbers that JSON cannot represent are written as null.
+ */
+static void write_number(Writer *w, double num) {
+	char digits[32], *c;
+	const char *point;
+	int precision;
+	double mag;
+
+	if (num - num != num - num) {
+		write_bytes(w, "null", 4);
+		return;
+	}
+
+	/* Zero is left to sprintf, which keeps the sign of negative zero */
+	mag = num < 0 ? -num : num;
+
+	for (precision = 0; mag != 0 && precision <= 22 && mag * exact_pow10[precision] < EXACT_MANTISSA; ++precision) {
+		UInt64 mant, end;
+
+		/* The scaled number could be off by one from the mantissa */
+		mant = (UInt64) (mag * exact_pow10[precision] + 0.5);
+		mant = mant ? mant - 1 : 0;
+
+		for (end = mant + 3; mant != end; ++mant) {
+			if ((double) mant / exact_pow10[precision] == mag) {
+				write_decimal(w, num < 0, mant, precision);
+				return;
+			}
+		}
+	}
+
+	/* Subnormal numbers have fewer bits, so fewer digits could do for them */
+	for (precision = mag < 2.2250738585072014e-308 ? 1 : 15; precision < 17; ++precision) {
+		sprintf(digits, "%.*g", precision, num);
+
+		if (strtod(digits, NULL) == num)
+			break;
+	}
+
+	if (precision == 17)
+		sprintf(digits, "%.17g", num);
+
+	/* Both functions use the decimal point of the current locale */
+	point = localeconv()->decimal_point;
+
+	if (point[0] != '.' || point[1]) {
+		if ((c = strstr(digits, point))) {
+			size_t len;
+
+			len = strlen(point);
+			*c = '.';
+			memmove(c + 1, c + len, strlen(c + len) + 1);
+		}
+	}
+
+	write_bytes(w, digits, strlen(digits));
+}
+
+/*
+ * Writes the mantissa with as many of its digits after the decimal point, or
+ * with an exponent if that keeps a small number shorter
+ */
+static void write_decimal(Writer *w, int negative, UInt64 mant, int decimals) {
+	char digits[24], out[48];
+	int count, exp, i, len;
+
+	count = 0;
+
+	do {
+		digits[sizeof(digits) - ++count] = (char) ('0' + mant % 10);
+		mant /= 10;
+	} while (mant);
+
+	len = 0;
+	if (negative)
+		out[len++] = '-';
+
+	/* Exponent of the first digit, small numbers get one if that is shorter */
+	exp = count - 1 - decimals;
+
+	if (exp < 0 && count + (count > 1) + (exp > -10 ? 3 : 4) < decimals + 2) {
+		out[len++] = digits[sizeof(digits) - count];
+
+		if (count > 1) {
+			out[len++] = '.';
+			memcpy(out + len, digits + sizeof(digits) - count + 1, count - 1);
+			len += count - 1;
+		}
+
+		len += sprintf(out + len, "e-%d", -exp);
+	} else if (decimals >= count) {
+		out[len++] = '0';
+		out[len++] = '.';
+
+		for (i = count; i < decimals; ++i)
+			out[len++] = '0';
+
+		memcpy(out + len, digits + sizeof(digits) - count, count);
+		len += count;
+	} else {
+		memcpy(out + len, digits + sizeof(digits) - count, count - decimals);
+		len += count - decimals;
+
+		if (decimals) {
+			out[len++] = '.';
+			memcpy(out + len, digits + sizeof(digits) - decimals, decimals);
+			len += decimals;
+		}
+	}
+
+	write_bytes(w, out, (size_t) len);
+}
+
+/* printf has no length modifier for it in C89 */
+static void write_integer(Writer *w, JYInt64 num) {
+	char digits[32];
+	UInt64 mag;
+	int i;
+
+	mag = num < 0 ? ~(UInt64) num + 1 : (UInt64) num;
+	i = sizeof(digits);
+
+	do {
+		digits[--i] = (char) ('0' + mag % 10);
+		mag /= 10;
+	} while (mag);
+
+	if (num < 0)
+		digits[--i] = '-';
+
+	write_bytes(w, digits + i, sizeof(digits) - i);
+}
+
+/*
+ * Adds up how big the contents of the value are in a snapshot, and collects
+ * its keys. Views and lazy values are parsed on the way.
+ */
+static void measure_value(Snapshot *s, JYValue *val) {
+	JYArray *arr;
+	JYObject *obj;
+	JYIterator it;
+	JYValue *elem;
+	const char *str;
+	size_t len;
+
+	if (s->failed)
+		return;
+
+	if (val->type == TYPE_NULL || val->type == TYPE_BOOL || val->type == TYPE_NUMBER || val->type == TYPE_INTEGER)
+		return;
+
+	if (jy_is_string_n(val, &str, &len)) {
+		s->length += ALIGN_UP(len + 1);
+	} else if (jy_is_array(val, &arr)) {
+		s->length += ALIGN_UP((size_t) arr->val.length * sizeof(JYValue));
+
+		jy_array_iter(arr, &it);
+		while ((elem = jy_array_next(&it)))
+			measure_value(s, elem);
+	} else if (jy_is_object(val, &obj) && jy_object_iter(obj, &it)) {
+		s->length += TABLE_BYTES(table_size(&obj->val)) + ALIGN_UP((size_t) obj->val.length * sizeof(Entry));
+
+		while ((elem = jy_object_next(&it, &str))) {
+			if (!snapshot_key(s, str)) {
+				s->failed = 1;
+				return;
+			}
+
+			measure_value(s, elem);
+		}
+	} else {
+		/* A string view or lazy subtree which could not be parsed */
+		s->failed = 1;
+	}
+}
+
+/* Copies the value into its place in the snapshot, and lays its contents out */
+static void copy_value(Snapshot *s, JYValue *to, JYValue *from) {
+	JYArray *arr;
+	JYObject *obj;
+	JYIterator it;
+	JYValue *elem;
+	const char *str;
+	size_t len, size;
+	char *data;
+
+	if (from->type == TYPE_NULL || from->type == TYPE_BOOL || from->type == TYPE_NUMBER || from->type == TYPE_INTEGER) {
+		to->type = from->type;
+		to->value = from->value;
+		return;
+	}
+
+	data = s->buf + s->length;
+
+	if (jy_is_string_n(from, &str, &len)) {
+		memcpy(data, str, len);
+		s->length += ALIGN_UP(len + 1);
+
+		to->type = TYPE_SNAPSHOT_STRING;
+		to->length = (Index) len;
+	} else if (jy_is_array(from, &arr)) {
+		JYValue *values;
+
+		values = (JYValue *) data;
+		s->length += ALIGN_UP((size_t) arr->val.length * sizeof(JYValue));
+
+		to->type = TYPE_SNAPSHOT_ARRAY;
+		to->length = arr->val.length;
+
+		jy_array_iter(arr, &it);
+		while ((elem = jy_array_next(&it)))
+			copy_value(s, values++, elem);
+	} else if (jy_is_object(from, &obj) && jy_object_iter(obj, &it)) {
+		Entry *entries;
+
+		/* Hash tables refer to pairs by their index, so they are copied as they are */
+		size = TABLE_BYTES(table_size(&obj->val));
+		if (size)
+			memcpy(data, (char *) it.next - size, size);
+
+		data += size;
+		entries = (Entry *) data;
+		s->length += size + ALIGN_UP((size_t) obj->val.length * sizeof(Entry));
+
+		to->type = TYPE_SNAPSHOT_OBJECT;
+		to->length = obj->val.length;
+		to->hashed = obj->val.hashed;
+
+		while ((elem = jy_object_next(&it, &str))) {
+			entries->key = s->buf + s->keys + snapshot_key(s, str)->offset - (char *) entries;
+			copy_value(s, &entries->value, elem);
+			++entries;
+		}
+	}
+
+	to->value._offset = data - (char *) to;
+}
+
+/* Finds the key among the keys of the snapshot, adding it if it is not there yet */
+static SnapshotKey *snapshot_key(Snapshot *s, const char *key) {
+	unsigned long hash;
+	size_t i;
+
+	hash = hash_key(key);
+	i = hash & s->mask;
+
+	if (s->slots) {
+		for (; s->slots[i].chars; i = (i + 1) & s->mask)
+			if (s->slots[i].hash == hash && !strcmp(s->slots[i].chars, key))
+				return &s->slots[i];
+	}
+
+	if ((s->count + 1) * 2 > (s->slots ? s->mask + 1 : 0)) {
+		if (!grow_snapshot_keys(s))
+			return NULL;
+
+		for (i = hash & s->mask; s->slots[i].chars; i = (i + 1) & s->mask)
+			;
+	}
+
+	s->slots[i].chars = key;
+	s->slots[i].length = strlen(key);
+	s->slots[i].offset = s->key_bytes;
+	s->slots[i].hash = hash;
+
+	s->key_bytes += s->slots[i].length + 1;
+	++s->count;
+
+	return &s->slots[i];
+}
+
+/* Doubles the slots of the keys of the snapshot, starting with 64 of them */
+static int grow_snapshot_keys(Snapshot *s) {
+	SnapshotKey *slots;
+	size_t size, i;
+
+	size = s->slots ? (s->mask + 1) * 2 : 64;
+
+	if (size > (size_t) -1 / sizeof(SnapshotKey) || !(slots = s->allocator->alloc(s->allocator->user, size * sizeof(SnapshotKey))))
+		return 0;
+
+	for (i = 0; i < size; ++i)
+		slots[i].chars = NULL;
+
+	if (s->slots) {
+		for (i = 0; i <= s->mask; ++i) {
+			size_t j;
+
+			if (!s->slots[i].chars)
+				continue;
+
+			for (j = s->slots[i].hash & (size - 1); slots[j].chars; j = (j + 1) & (size - 1))
+				;
+
+			slots[j] = s->slots[i];
+		}
+
+		s->allocator->free(s->allocator->user, s->slots);
+	}
+
+	s->slots = slots;
+	s->mask = size - 1;
+	return 1;
+}
+
+/* Size of the hash table in front of the pairs of the object, or zero */
+static size_t table_size(JYValue *obj) {
+	char *elements;
+
+	if (!obj->hashed)
+		return 0;
+
+	elements = obj->type == TYPE_SNAPSHOT_OBJECT ? SNAPSHOT_DATA(obj) : (char *) obj->value._pairs;
+	return (size_t) ((Index *) elements)[-1] + 1;
+}
+
+#ifndef NDEBUG
+static int print_chunk(void *user, const char *data, size_t len) {
+	return fwrite(data, 1, len, (FILE *) user) == len;
+}
+#endif /* NDEBUG */
+
+static void *default_alloc(void *user, size_t size) {
+	(void) user;
+	return malloc(size);
+}
+
+static void default_free(void *user, void *ptr) {
+	(void) user;
+	free(ptr);
+}
+
+static void *arena_alloc(JYArena *arena, size_t size) {
+	Block *block;
+	char *ptr;
+
+	size = ALIGN_UP(size);
+	block = arena->current;
+
+	while (block->header.size - block->header.used < size) {
+		if (!block->header.next) {
+			Block *next;
+			size_t blocksize;
+
+			blocksize = arena->next_size;
+			if (blocksize < size)
+				blocksize = size;
+
+			next = arena->allocator.alloc(arena->allocator.user, sizeof(Block) + blocksize);
+			if (!next)
+				return NULL;
+
+			next->header.next = NULL;
+			next->header.size = blocksize;
+			next->header.used = 0;
+			block->header.next = next;
+
+		#ifdef JAYCEON_STATS
+			++arena->allocs;
+			arena->allocated += sizeof(Block) + blocksize;
+		#endif
+
+			if (arena->next_size < JAYCEON_ARENA_MAX_BLOCK_SIZE / 2)
+				arena->next_size *= 2;
+			else
+				arena->next_size = JAYCEON_ARENA_MAX_BLOCK_SIZE;
+		}
+
+		block = block->header.next;
+	}
+
+	arena->current = block;
+
+	ptr = (char *) (block + 1) + block->header.used;
+	block->header.used += size;
+
+	return ptr;
+}
+
+/* Gives back the end of the most recent allocation */
+static void arena_shrink(JYArena *arena, void *ptr, size_t size, size_t newsize) {
+	Block *block;
+
+	block = arena->current;
+	size = ALIGN_UP(size);
+	newsize = ALIGN_UP(newsize);
+
+	if ((char *) ptr + size == (char *) (block + 1) + block->header.used)
+		block->header.used -= size - newsize;
+}
+
+/* Grows the most recent allocation in place, if its block has the room */
+static int arena_extend(JYArena *arena, void *ptr, size_t size, size_t newsize) {
+	Block *block;
+
+	block = arena->current;
+	size = ALIGN_UP(size);
+	newsize = ALIGN_UP(newsize);
+
+	if ((char *) ptr + size != (char *) (block + 1) + block->header.used)
+		return 0;
+
+	if (newsize - size > block->header.size - block->header.used)
+		return 0;
+
+	block->header.used += newsize - size;
+	return 1;
+}
+
+static Mark arena_mark(JYArena *arena) {
+	Mark mark;
+
+	mark.block = arena->current;
+	mark.used = arena->current->header.used;
+
+	return mark;
+}
+
+static void arena_rewind(JYArena *arena, Mark mark) {
+	Block *block;
+
+	mark.block->header.used = mark.used;
+
+	for (block = mark.block->header.next; block; block = block->header.next)
+		block->header.used = 0;
+
+	arena->current = mark.block;
+}
+
+static void *stack_push(Parser *p, const void *data, size_t size) {
+	char *top;
+
+	if (p->capacity - p->top < size) {
+		const JYAllocator *allocator;
+		size_t newcap;
+		char *newstack;
+
+		allocator = p->allocator;
+
+		newcap = p->capacity * 2;
+		while (newcap - p->top < size)
+			newcap *= 2;
+
+		newstack = allocator->alloc(allocator->user, newcap);
+		if (!newstack) {
+			set_error(p, JY_ERROR_MEMORY, NULL);
+			return NULL;
+		}
+
+		COUNT_MEMORY(p, newcap, p->stack != (char *) p->inline_stack ? p->capacity : 0, 1);
+
+		memcpy(newstack, p->stack, p->top);
+
+		if (p->stack != (char *) p->inline_stack)
+			allocator->free(allocator->user, p->stack);
+
+		p->stack = newstack;
+		p->capacity = newcap;
+	}
+
+	top = p->stack + p->top;
+	if (data)
+		memcpy(top, data, size);
+
+	p->top += size;
+
+	return top;
+}
+
+/* Allocates from the arena of the parser, which fails parsing if it runs out */
+static void *parser_alloc(Parser *p, size_t size) {
+	void *ptr;
+
+	if (!(ptr = arena_alloc(p->arena, size)))
+		set_error(p, JY_ERROR_MEMORY, NULL);
+
+	return ptr;
+}
+
+#ifdef JAYCEON_STATS
+/*
+ * Counts an allocation of temporary memory, which is held along with the block
+ * it replaces until that one is freed, and the arena blocks allocated so far
+ */
+static void count_memory(Parser *p, size_t allocated, size_t freed, int grown) {
+	JYStats *stats;
+	size_t memory;
+
+	if (!(stats = p->stats))
+		return;
+
+	++stats->allocs;
+	if (grown)
+		++stats->grows;
+
+	p->memory += allocated;
+	memory = p->memory + (p->arena->allocated - p->arena_allocated);
+
+	if (memory > stats->peak_bytes)
+		stats->peak_bytes = memory;
+
+	p->memory -= freed;
+}
+
+/* Counts an array or object, nested depth deep */
+static void count_container(Parser *p, int object, size_t depth) {
+	JYStats *stats;
+
+	if (!(stats = p->stats))
+		return;
+
+	if (object)
+		++stats->objects;
+	else
+		++stats->arrays;
+
+	if (depth > stats->max_depth)
+		stats->max_depth = depth;
+}
+
+/* Parses a scalar, counting it by its type, and timing numbers and strings */
+static const char *count_scalar(Parser *p, const char *string, JYValue *out) {
+	JYStats *stats;
+	const char *end;
+	double start, elapsed;
+
+	stats = p->stats;
+	p->counting = 1;
+
+	start = STATS_CLOCK();
+	end = parse_scalar(p, string, out);
+	elapsed = STATS_CLOCK() - start;
+
+	p->counting = 0;
+
+	if (!end)
+		return NULL;
+
+	switch (out->type) {
+		case TYPE_NULL:
+			++stats->nulls;
+			break;
+
+		case TYPE_BOOL:
+			++stats->bools;
+			break;
+
+		case TYPE_NUMBER:
+		case TYPE_INTEGER:
+			++stats->numbers;
+			stats->number_seconds += elapsed;
+			break;
+
+		default:
+			++stats->strings;
+			stats->string_seconds += elapsed;
+			break;
+	}
+
+	return end;
+}
+
+/* Same as count_scalar, for keys */
+static const char *count_key(Parser *p, const char *string, char **out) {
+	const char *end;
+	double start, elapsed;
+
+	p->counting = 1;
+
+	start = STATS_CLOCK();
+	end = parse_key(p, string, out);
+	elapsed = STATS_CLOCK() - start;
+
+	p->counting = 0;
+
+	if (end) {
+		++p->stats->keys;
+		p->stats->string_seconds += elapsed;
+	}
+
+	return end;
+}
+
+/*
+ * Adds up what parsing took from the arena since the mark, and the blocks it
+ * allocated, while the temporary memory is still held
+ */
+static void finish_stats(Parser *p, Mark mark) {
+	JYStats *stats;
+	Block *block;
+	size_t used, memory;
+
+	if (!(stats = p->stats))
+		return;
+
+	stats->allocs += p->arena->allocs - p->arena_allocs;
+
+	memory = p->memory + (p->arena->allocated - p->arena_allocated);
+	if (memory > stats->peak_bytes)
+		stats->peak_bytes = memory;
+
+	/* Blocks past the current one are always empty */
+	used = 0;
+	for (block = mark.block; block; block = block->header.next)
+		used += block->header.used;
+
+	stats->arena_bytes = used - mark.used;
+}
+#endif
+
+/* The header in front of the elements of an array or object, if it was changed */
+static Growth *get_growth(JYValue *val) {
+	char *elements;
+
+	if (!val->growable)
+		return NULL;
+
+	elements = val->type == TYPE_ARRAY ? (char *) val->value._values : (char *) val->value._pairs;
+	return (Growth *) (elements - GROWTH_BYTES);
+}
+
+/*
+ * Makes room for one more element, doubling the capacity when it runs out. The
+ * first time, the elements are moved into memory with a header, losing the hash
+ * table of an object if it had one.
+ */
+static int reserve_element(JYDocument *doc, JYValue *val, size_t size) {
+	Growth *growth, *newgrowth;
+	size_t capacity, sorted;
+	char *elements;
+
+	elements = val->type == TYPE_ARRAY ? (char *) val->value._values : (char *) val->value._pairs;
+	growth = get_growth(val);
+
+	if (growth) {
+		if (val->length < growth->capacity)
+			return 1;
+
+		capacity = growth->capacity * 2;
+		sorted = growth->sorted;
+
+		if (capacity > INDEX_MAX || capacity > ((size_t) -1 - GROWTH_BYTES) / size)
+			return 0;
+
+		if (arena_extend(doc->arena, growth, GROWTH_BYTES + growth->capacity * size, GROWTH_BYTES + capacity * size)) {
+			growth->capacity = capacity;
+			return 1;
+		}
+	} else {
+		if (val->length >= INDEX_MAX)
+			return 0;
+
+		capacity = val->length < 4 ? 8 : (size_t) val->length * 2;
+		sorted = val->length;
+
+		if (capacity > ((size_t) -1 - GROWTH_BYTES) / size)
+			return 0;
+	}
+
+	newgrowth = arena_alloc(doc->arena, GROWTH_BYTES + capacity * size);
+	if (!newgrowth)
+		return 0;
+
+	newgrowth->arena = doc->arena;
+	newgrowth->capacity = capacity;
+	newgrowth->sorted = sorted;
+	newgrowth->added = growth ? growth->added : NULL;
+	newgrowth->mask = growth ? growth->mask : 0;
+
+	if (val->length)
+		memcpy((char *) newgrowth + GROWTH_BYTES, elements, val->length * size);
+
+	if (val->type == TYPE_ARRAY)
+		val->value._values = (JYValue *) ((char *) newgrowth + GROWTH_BYTES);
+	else
+		val->value._pairs = (Pair *) ((char *) newgrowth + GROWTH_BYTES);
+
+	val->hashed = 0;
+	val->growable = 1;
+	return 1;
+}
+
+/*
+ * Sorts the pairs that were added to the object, and merges them with the ones
+ * that were already sorted. Of the pairs with the same key, the last one added
+ * is kept.
+ */
+static int merge_pairs(JYValue *obj) {
+	const JYAllocator *allocator;
+	Growth *growth;
+	Pair *pairs, *added, *scratch, *sorted;
+	size_t count, i, j, k;
+
+	growth = get_growth(obj);
+	if (!growth || growth->sorted == obj->length)
+		return 1;
+
+	allocator = &growth->arena->allocator;
+	pairs = obj->value._pairs;
+	added = pairs + growth->sorted;
+	count = obj->length - growth->sorted;
+
+	scratch = allocator->alloc(allocator->user, obj->length * sizeof(Pair));
+	if (!scratch)
+		return 0;
+
+	sorted = sort_pairs(added, scratch, count, 1);
+	if (sorted != added)
+		memcpy(added, sorted, count * sizeof(Pair));
+
+	for (i = 0, j = 0; i < count; ++i) {
+		if (j && !COMPARE_KEYS(added[j - 1].key, added[i].key))
+			--j;
+
+		added[j++] = added[i];
+	}
+
+	count = j;
+
+	for (i = 0, j = 0, k = 0; i < growth->sorted || j < count; ) {
+		int res;
+
+		if (i == growth->sorted)
+			res = 1;
+		else if (j == count)
+			res = -1;
+		else
+			res = COMPARE_KEYS(pairs[i].key, added[j].key);
+
+		if (res == 0)
+			++i;
+
+		scratch[k++] = res < 0 ? pairs[i++] : added[j++];
+	}
+
+	memcpy(pairs, scratch, k * sizeof(Pair));
+	allocator->free(allocator->user, scratch);
+
+	obj->length = (Index) k;
+	growth->sorted = k;
+
+	if (growth->added)
+		memset(growth->added, 0, (growth->mask + 1) * sizeof(Index));
+
+	return 1;
+}
+
+/* Slot of the key in the table of added pairs, or the empty one it would go in */
+static Index *find_added(Growth *growth, Pair *pairs, const char *key, unsigned long hash) {
+	size_t i;
+
+	for (i = hash & growth->mask; growth->added[i]; i = (i + 1) & growth->mask) {
+		if (!COMPARE_KEYS(pairs[growth->added[i] - 1].key, key))
+			break;
+	}
+
+	return &growth->added[i];
+}
+
+/* Makes room in the table of added pairs for one more, doubling it when needed */
+static int reserve_added(JYDocument *doc, Growth *growth, Pair *pairs, size_t length) {
+	Index *added;
+	size_t size, i;
+
+	size = growth->added ? growth->mask + 1 : 0;
+
+	if ((length - growth->sorted + 1) * 2 <= size)
+		return 1;
+
+	size = size ? size * 2 : 16;
+
+	if (size > (size_t) -1 / sizeof(Index) || !(added = arena_alloc(doc->arena, size * sizeof(Index))))
+		return 0;
+
+	memset(added, 0, size * sizeof(Index));
+	growth->added = added;
+	growth->mask = size - 1;
+
+	for (i = growth->sorted; i < length; ++i)
+		*find_added(growth, pairs, pairs[i].key, hash_key(pairs[i].key)) = (Index) (i + 1);
+
+	return 1;
+}
+
+/* Values of a node are set to where it is, so that it reads like any other value */
+static JYValue *new_node(JYDocument *doc, JYValue *val, Type type) {
+	JYValue *node;
+
+	node = arena_alloc(doc->arena, sizeof(JYValue));
+	if (!node)
+		return NULL;
+
+	node->type = type;
+	node->value._values = NULL;
+	node->length = 0;
+	node->hashed = 0;
+	node->growable = 0;
+
+	val->type = TYPE_NODE;
+	val->value._node = node;
+	return node;
+}
+
+/*
+ * Scanners skip runs of characters that need no further attention: whitespace
+ * between tokens, and characters of strings which are neither a quote, a
+ * backslash or a control character. The vectorized ones look at a whole block
+ * at a time and finish the input with the scalar ones.
+ */
+static const char *skip_space_scalar(const char *string, const char *end) {
+	while (string != end && IS_SPACE(*string))
+		++string;
+
+	return string;
+}
+
+static const char *scan_plain_scalar(const char *string, const char *end) {
+	while (string != end && !IS_SPECIAL(*string))
+		++string;
+
+	return string;
+}
+
+static const char *scan_ascii_scalar(const char *string, const char *end) {
+	while (string != end && !IS_SPECIAL(*string) && !((unsigned char) *string & 0x80))
+		++string;
+
+	return string;
+}
+
+static unsigned first_bit(unsigned long mask) {
+#if defined(__GNUC__)
+	return (unsigned) __builtin_ctzl(mask);
+#elif defined(_MSC_VER)
+	unsigned long index;
+
+	_BitScanForward(&index, mask);
+	return (unsigned) index;
+#else
+	unsigned index;
+
+	for (index = 0; !(mask & 1); ++index)
+		mask >>= 1;
+
+	return index;
+#endif
+}
+
+#ifdef SIMD_SSE2
+static const char *skip_space_sse2(const char *string, const char *end) {
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+
+	while (end - string >= 16) {
+		__m128i block, match;
+		unsigned mask;
+
+		block = _mm_loadu_si128((const __m128i *) string);
+		match = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+			_mm_or_si128(_mm_cmpeq_epi8(block, lf), _mm_cmpeq_epi8(block, cr)));
+
+		mask = (unsigned) _mm_movemask_epi8(match) ^ 0xFFFFu;
+		if (mask)
+			return string + first_bit(mask);
+
+		string += 16;
+	}
+
+	return skip_space_scalar(string, end);
+}
+
+static const char *scan_plain_sse2(const char *string, const char *end) {
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+
+	while (end - string >= 16) {
+		__m128i block, match;
+		unsigned mask;
+
+		block = _mm_loadu_si128((const __m128i *) string);
+		match = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(block, control), control));
+
+		mask = (unsigned) _mm_movemask_epi8(match);
+		if (mask)
+			return string + first_bit(mask);
+
+		string += 16;
+	}
+
+	return scan_plain_scalar(string, end);
+}
+
+static const char *scan_ascii_sse2(const char *string, const char *end) {
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+
+	while (end - string >= 16) {
+		__m128i block, match;
+		unsigned mask;
+
+		block = _mm_loadu_si128((const __m128i *) string);
+		match = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(block, control), control));
+
+		/* The sign bits are those of the characters past ASCII */
+		mask = (unsigned) (_mm_movemask_epi8(match) | _mm_movemask_epi8(block));
+		if (mask)
+			return string + first_bit(mask);
+
+		string += 16;
+	}
+
+	return scan_ascii_scalar(string, end);
+}
+#endif /* SIMD_SSE2 */
+
+#ifdef SIMD_AVX2
+__attribute__((target("avx2")))
+static const char *skip_space_avx2(const char *string, const char *end) {
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i cr = _mm256_set1_epi8('\r');
+
+	while (end - string >= 32) {
+		__m256i block, match;
+		unsigned mask;
+
+		block = _mm256_loadu_si256((const __m256i *) string);
+		match = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, lf), _mm256_cmpeq_epi8(block, cr)));
+
+		mask = ~(unsigned) _mm256_movemask_epi8(match);
+		if (mask)
+			return string + first_bit(mask);
+
+		string += 32;
+	}
+
+	return skip_space_sse2(string, end);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_plain_avx2(const char *string, const char *end) {
+	const __m256i quote = _mm256_set1_epi8('\"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control = _mm256_set1_epi8(0x1F);
+
+	while (end - string >= 32) {
+		__m256i block, match;
+		unsigned mask;
+
+		block = _mm256_loadu_si256((const __m256i *) string);
+		match = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+			_mm256_cmpeq_epi8(_mm256_max_epu8(block, control), control));
+
+		mask = (unsigned) _mm256_movemask_epi8(match);
+		if (mask)
+			return string + first_bit(mask);
+
+		string += 32;
+	}
+
+	return scan_plain_sse2(string, end);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_ascii_avx2(const char *string, const char *end) {
+	const __m256i quote = _mm256_set1_epi8('\"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control = _mm256_set1_epi8(0x1F);
+
+	while (end - string >= 32) {
+		__m256i block, match;
+		unsigned mask;
+
+		block = _mm256_loadu_si256((const __m256i *) string);
+		match = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+			_mm256_cmpeq_epi8(_mm256_max_epu8(block, control), control));
+
+		mask = (unsigned) (_mm256_movemask_epi8(match) | _mm256_movemask_epi8(block));
+		if (mask)
+			return string + first_bit(mask);
+
+		string += 32;
+	}
+
+	return scan_ascii_sse2(string, end);
+}
+#endif /* SIMD_AVX2 */
+
+#ifdef SIMD_NEON
+/* Narrows a byte mask down to four bits per byte */
+static unsigned long neon_mask(uint8x16_t match) {
+	uint8x8_t narrow;
+
+	narrow = vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+	return (unsigned long) vget_lane_u64(vreinterpret_u64_u8(narrow), 0);
+}
+
+static const char *skip_space_neon(const char *string, const char *end) {
+	const uint8x16_t space = vdupq_n_u8(' ');
+	const uint8x16_t tab = vdupq_n_u8('\t');
+	const uint8x16_t lf = vdupq_n_u8('\n');
+	const uint8x16_t cr = vdupq_n_u8('\r');
+
+	while (end - string >= 16) {
+		uint8x16_t block, match;
+		unsigned long mask;
+
+		block = vld1q_u8((const uint8_t *) string);
+		match = vorrq_u8(
+			vorrq_u8(vceqq_u8(block, space), vceqq_u8(block, tab)),
+			vorrq_u8(vceqq_u8(block, lf), vceqq_u8(block, cr)));
+
+		mask = ~neon_mask(match);
+		if (mask)
+			return string + first_bit(mask) / 4;
+
+		string += 16;
+	}
+
+	return skip_space_scalar(string, end);
+}
+
+static const char *scan_plain_neon(const char *string, const char *end) {
+	const uint8x16_t quote = vdupq_n_u8('\"');
+	const uint8x16_t backslash = vdupq_n_u8('\\');
+	const uint8x16_t control = vdupq_n_u8(0x20);
+
+	while (end - string >= 16) {
+		uint8x16_t block, match;
+		unsigned long mask;
+
+		block = vld1q_u8((const uint8_t *) string);
+		match = vorrq_u8(
+			vorrq_u8(vceqq_u8(block, quote), vceqq_u8(block, backslash)),
+			vcltq_u8(block, control));
+
+		mask = neon_mask(match);
+		if (mask)
+			return string + first_bit(mask) / 4;
+
+		string += 16;
+	}
+
+	return scan_plain_scalar(string, end);
+}
+
+static const char *scan_ascii_neon(const char *string, const char *end) {
+	const uint8x16_t quote = vdupq_n_u8('\"');
+	const uint8x16_t backslash = vdupq_n_u8('\\');
+	const uint8x16_t control = vdupq_n_u8(0x20);
+	const uint8x16_t ascii = vdupq_n_u8(0x7F);
+
+	while (end - string >= 16) {
+		uint8x16_t block, match;
+		unsigned long mask;
+
+		block = vld1q_u8((const uint8_t *) string);
+		match = vorrq_u8(
+			vorrq_u8(vceqq_u8(block, quote), vceqq_u8(block, backslash)),
+			vorrq_u8(vcltq_u8(block, control), vcgtq_u8(block, ascii)));
+
+		mask = neon_mask(match);
+		if (mask)
+			return string + first_bit(mask) / 4;
+
+		string += 16;
+	}
+
+	return scan_ascii_scalar(string, end);
+}
+#endif /* SIMD_NEON */
+
+/*
+ * Classifiers set a bit for each character of a BLOCK_SIZE block that belongs
+ * to one of the classes the structural index is built from
+ */
+static void classify_scalar(const char *block, Masks *out) {
+	int i;
+
+	out->backslash = out->quote = out->op = out->space = out->slash = 0;
+
+	for (i = BLOCK_SIZE - 1; i >= 0; --i) {
+		char c;
+
+		c = block[i];
+
+		out->backslash = out->backslash << 1 | (c == '\\');
+		out->quote = out->quote << 1 | (c == '\"');
+		out->op = out->op << 1 | (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',');
+		out->space = out->space << 1 | IS_SPACE(c);
+		out->slash = out->slash << 1 | (c == '/');
+	}
+}
+
+#ifdef SIMD_SSE2
+static void classify_sse2(const char *block, Masks *out) {
+	int i;
+
+	out->backslash = out->quote = out->op = out->space = out->slash = 0;
+
+	for (i = 0; i < BLOCK_SIZE; i += 16) {
+		__m128i chars, op, space;
+
+		chars = _mm_loadu_si128((const __m128i *) (block + i));
+
+		op = _mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('{')),
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('}'))),
+			_mm_or_si128(
+				_mm_or_si128(
+					_mm_cmpeq_epi8(chars, _mm_set1_epi8('[')),
+					_mm_cmpeq_epi8(chars, _mm_set1_epi8(']'))),
+				_mm_or_si128(
+					_mm_cmpeq_epi8(chars, _mm_set1_epi8(':')),
+					_mm_cmpeq_epi8(chars, _mm_set1_epi8(',')))));
+
+		space = _mm_or_si128(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('\t'))),
+			_mm_or_si128(
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+				_mm_cmpeq_epi8(chars, _mm_set1_epi8('\r'))));
+
+		out->backslash |= (unsigned long) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'))) << i;
+		out->quote |= (unsigned long) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\"'))) << i;
+		out->op |= (unsigned long) _mm_movemask_epi8(op) << i;
+		out->space |= (unsigned long) _mm_movemask_epi8(space) << i;
+		out->slash |= (unsigned long) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8('/'))) << i;
+	}
+}
+#endif /* SIMD_SSE2 */
+
+#ifdef SIMD_AVX2
+__attribute__((target("avx2")))
+static void classify_avx2(const char *block, Masks *out) {
+	__m256i chars, op, space;
+
+	chars = _mm256_loadu_si256((const __m256i *) block);
+
+	op = _mm256_or_si256(
+		_mm256_or_si256(
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('{')),
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('}'))),
+		_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('[')),
+				_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(']'))),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(':')),
+				_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(',')))));
+
+	space = _mm256_or_si256(
+		_mm256_or_si256(
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')),
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t'))),
+		_mm256_or_si256(
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')),
+			_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\r'))));
+
+	out->backslash = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\\')));
+	out->quote = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\"')));
+	out->op = (unsigned) _mm256_movemask_epi8(op);
+	out->space = (unsigned) _mm256_movemask_epi8(space);
+	out->slash = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/')));
+}
+#endif /* SIMD_AVX2 */
+
+#ifdef SIMD_NEON
+/* Gathers the top bit of each byte into a 16 bit mask */
+static unsigned long neon_movemask(uint8x16_t match) {
+	static const uint8_t weights[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+	};
+	uint8x16_t bits;
+
+	bits = vandq_u8(match, vld1q_u8(weights));
+	bits = vpaddq_u8(bits, bits);
+	bits = vpaddq_u8(bits, bits);
+	bits = vpaddq_u8(bits, bits);
+
+	return (unsigned long) vgetq_lane_u16(vreinterpretq_u16_u8(bits), 0);
+}
+
+static void classify_neon(const char *block, Masks *out) {
+	int i;
+
+	out->backslash = out->quote = out->op = out->space = out->slash = 0;
+
+	for (i = 0; i < BLOCK_SIZE; i += 16) {
+		uint8x16_t chars, op, space;
+
+		chars = vld1q_u8((const uint8_t *) (block + i));
+
+		op = vorrq_u8(
+			vorrq_u8(vceqq_u8(chars, vdupq_n_u8('{')), vceqq_u8(chars, vdupq_n_u8('}'))),
+			vorrq_u8(
+				vorrq_u8(vceqq_u8(chars, vdupq_n_u8('[')), vceqq_u8(chars, vdupq_n_u8(']'))),
+				vorrq_u8(vceqq_u8(chars, vdupq_n_u8(':')), vceqq_u8(chars, vdupq_n_u8(',')))));
+
+		space = vorrq_u8(
+			vorrq_u8(vceqq_u8(chars, vdupq_n_u8(' ')), vceqq_u8(chars, vdupq_n_u8('\t'))),
+			vorrq_u8(vceqq_u8(chars, vdupq_n_u8('\n')), vceqq_u8(chars, vdupq_n_u8('\r'))));
+
+		out->backslash |= neon_movemask(vceqq_u8(chars, vdupq_n_u8('\\'))) << i;
+		out->quote |= neon_movemask(vceqq_u8(chars, vdupq_n_u8('\"'))) << i;
+		out->op |= neon_movemask(op) << i;
+		out->space |= neon_movemask(space) << i;
+		out->slash |= neon_movemask(vceqq_u8(chars, vdupq_n_u8('/'))) << i;
+	}
+}
+#endif /* SIMD_NEON */
+
+/* Picks the widest scanners and classifier the processor supports */
+static void select_scanners(Parser *p) {
+	p->skip_space = skip_space_scalar;
+	p->scan_plain = scan_plain_scalar;
+	p->scan_ascii = scan_ascii_scalar;
+	p->classify = classify_scalar;
+
+#if defined(SIMD_SSE2)
+	p->skip_space = skip_space_sse2;
+	p->scan_plain = scan_plain_sse2;
+	p->scan_ascii = scan_ascii_sse2;
+	p->classify = classify_sse2;
+#elif defined(SIMD_NEON)
+	p->skip_space = skip_space_neon;
+	p->scan_plain = scan_plain_neon;
+	p->scan_ascii = scan_ascii_neon;
+	p->classify = classify_neon;
+#endif
+
+#ifdef SIMD_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		p->skip_space = skip_space_avx2;
+		p->scan_plain = scan_plain_avx2;
+		p->scan_ascii = scan_ascii_avx2;
+		p->classify = classify_avx2;
+	}
+#endif
+}
+
+static const char *parse_space(Parser *p, const char *string) {
+	for (;;) {
+		if (string != p->end && IS_SPACE(*string))
+			string = p->skip_space(string + 1, p->end);
+
+	#ifndef JAYCEON_NO_COMMENT_SUPPORT
+		if (PEEK(p, string) == '/' && PEEK(p, string + 1) == '/') {
+			string += 2;
+
+			string = memchr(string, '\n', (size_t) (p->end - string));
+			if (!string)
+				string = p->end;
+
+			continue;
+		} else if (PEEK(p, string) == '/' && PEEK(p, string + 1) == '*') {
+			string += 2;
+
+			while (string != p->end) {
+				if (PEEK(p, string) == '*' && PEEK(p, string + 1) == '/') {
+					string += 2;
+					break;
+				}
+
+				++string;
+			}
+
+			continue;
+		}
+	#endif
+
+		return string;
+	}
+}
+
+static const char *parse_null(Parser *p, const char *string) {
+	int i;
+
+	if (p->end - string < 4)
+		return NULL;
+
+	for (i = 0; i < 4; ++i)
+		if (string[i] != "null"[i])
+			return NULL;
+
+	return string + 4;
+}
+
+static const char *parse_bool(Parser *p, const char *string, int *out) {
+	const char *word;
+	int val;
+
+	word = PEEK(p, string) == 't' ? "true" : "false";
+
+	val = *word == 't';
+
+	while (*word) {
+		if (*word != PEEK(p, string))
+			return NULL;
+		
+		++word, ++string;
+	}
+
+	*out = val;
+	return string;
+}
+
+/*
+ * Integers that fit are kept as they are. Other numbers are put together from
+ * their digits when those and the power of ten are both exact doubles, since a
+ * single multiplication or division of them is correctly rounded (Clinger's
+ * fast path). The rest are left to strtod.
+ */
+static const char *parse_number(Parser *p, const char *string, JYValue *out) {
+	const UInt64 CUTOFF = (~(UInt64) 0 - 9) / 10;
+	const char *begin;
+	UInt64 mantissa;
+	long exp;
+	int negative, integer, overflow;
+	double val;
+
+	negative = PEEK(p, string) == '-';
+
+	if (negative)
+		++string;
+
+	begin = string;
+
+	if (!IS_DIGIT(PEEK(p, string)))
+		return NULL;
+
+	mantissa = 0;
+	exp = 0;
+	integer = 1;
+	overflow = 0;
+
+	/* Leading zeros are not permitted */
+	if (*string == '0') {
+		++string;
+	} else {
+		for (; string != p->end && IS_DIGIT(*string); ++string) {
+			if (mantissa > CUTOFF)
+				overflow = 1;
+			else
+				mantissa = mantissa * 10 + (UInt64) (*string - '0');
+		}
+	}
+
+	if (PEEK(p, string) == '.') {
+		++string;
+
+		if (!IS_DIGIT(PEEK(p, string)))
+			return NULL;
+
+		integer = 0;
+
+		for (; string != p->end && IS_DIGIT(*string); ++string) {
+			if (mantissa > CUTOFF) {
+				overflow = 1;
+			} else {
+				mantissa = mantissa * 10 + (UInt64) (*string - '0');
+				--exp;
+			}
+		}
+	}
+
+	if (PEEK(p, string) == 'e' || PEEK(p, string) == 'E') {
+		int sign;
+		long e;
+
+		++string;
+		sign = 0;
+
+		if (PEEK(p, string) == '+') {
+			++string;
+		} else if (PEEK(p, string) == '-') {
+			++string;
+			sign = 1;
+		}
+
+		if (!IS_DIGIT(PEEK(p, string)))
+			return NULL;
+
+		integer = 0;
+		e = 0;
+		
+		/* Anything this big is out of range either way */
+		for (; string != p->end && IS_DIGIT(*string); ++string) {
+			if (e < 100000)
+				e = e * 10 + (*string - '0');
+		}
+
+		exp += sign ? -e : e;
+	}
+
+	if (integer && !overflow) {
+		UInt64 max;
+
+		max = ~(UInt64) 0 >> 1;
+
+		/* Negative zero is left to the double */
+		if (negative && mantissa && mantissa - 1 <= max) {
+			out->type = TYPE_INTEGER;
+			out->value._integer = -(JYInt64) (mantissa - 1) - 1;
+			return string;
+		} else if (!negative && mantissa <= max) {
+			out->type = TYPE_INTEGER;
+			out->value._integer = (JYInt64) mantissa;
+			return string;
+		}
+	}
+
+	val = (double) mantissa;
+
+	if (overflow || val >= EXACT_MANTISSA || exp < -22 || exp > 22 + 15) {
+		if (!convert_number(p, begin, string, &val))
+			return NULL;
+	} else if (exp < 0) {
+		val = val / exact_pow10[-exp];
+	} else if (exp <= 22) {
+		val = val * exact_pow10[exp];
+	} else if (val * exact_pow10[exp - 22] < EXACT_MANTISSA) {
+		/* Moving zeros over to the mantissa keeps it exact */
+		val = val * exact_pow10[exp - 22] * exact_pow10[22];
+	} else if (!convert_number(p, begin, string, &val)) {
+		return NULL;
+	}
+
+	if (negative)
+		val = -val;
+
+	out->type = TYPE_NUMBER;
+	out->value._number = val;
+	return string;
+}
+
+/*
+ * Converts the digits of a number with strtod. They are copied onto the stack
+ * to be terminated, with the decimal point of the current locale.
+ */
+static int convert_number(Parser *p, const char *string, const char *end, double *out) {
+	const char *point, *dot;
+	size_t base;
+
+	/* Nobody is going to look at the value, like when validating */
+	if (p->handler && !p->handler->number) {
+		*out = 0.0;
+		return 1;
+	}
+
+	base = p->top;
+	point = localeconv()->decimal_point;
+	dot = memchr(string, '.', (size_t) (end - string));
+
+	if (dot) {
+		if (!stack_push(p, string, (size_t) (dot - string)) ||
+			!stack_push(p, point, strlen(point)) ||
+			!stack_push(p, dot + 1, (size_t) (end - dot - 1))) {
+			p->top = base;
+			return 0;
+		}
+	} else if (!stack_push(p, string, (size_t) (end - string))) {
+		p->top = base;
+		return 0;
+	}
+
+	if (!stack_push(p, "", 1)) {
+		p->top = base;
+		return 0;
+	}
+
+	*out = strtod(p->stack + base, NULL);
+	p->top = base;
+	return 1;
+}
+
+/*
+ * Finds the closing quote of a string, checking its escape sequences on the
+ * way, so that decoding it later on can never fail. Control characters have to
+ * be escaped. When validating UTF-8, runs of ASCII are scanned for the first
+ * character past it, and the sequences from there are checked one at a time.
+ */
+static const char *scan_string(Parser *p, const char *string, int *escaped) {
+	const char *next;
+	Scanner scan;
+
+	scan = p->utf8 ? p->scan_ascii : p->scan_plain;
+	*escaped = 0;
+
+	for (;;) {
+		string = scan(string, p->end);
+
+		if (string == p->end) {
+			set_error(p, JY_ERROR_SYNTAX, string);
+			return NULL;
+		} else if (*string == '\"') {
+			return string;
+		} else if ((unsigned char) *string & 0x80) {
+			next = scan_utf8(string, p->end);
+		} else if (*string != '\\') {
+			next = NULL;
+		} else if ((next = scan_escape(string + 1, p->end))) {
+			*escaped = 1;
+		}
+
+		if (!next) {
+			set_error(p, JY_ERROR_STRING, string);
+			return NULL;
+		}
+
+		string = next;
+	}
+}
+
+/*
+ * Checks the escape sequence after a backslash, and returns where it ends. A
+ * \uXXXX sequence of a high surrogate has to be followed by one of a low
+ * surrogate, they stand for a single character together.
+ */
+static const char *scan_escape(const char *string, const char *end) {
+	long code;
+
+	if (string == end || *string == '\0')
+		return NULL;
+
+	if (*string != 'u')
+		return strchr("nrbft\"\\/", *string) ? string + 1 : NULL;
+
+	if ((code = read_hex(string + 1, end)) < 0)
+		return NULL;
+
+	string += 5;
+
+	if (code >= 0xDC00 && code <= 0xDFFF)
+		return NULL;
+
+	if (code >= 0xD800 && code <= 0xDBFF) {
+		if (end - string < 2 || string[0] != '\\' || string[1] != 'u')
+			return NULL;
+
+		if ((code = read_hex(string + 2, end)) < 0xDC00 || code > 0xDFFF)
+			return NULL;
+
+		string += 6;
+	}
+
+	return string;
+}
+
+/* Checks the UTF-8 sequences up to the next ASCII character */
+static const char *scan_utf8(const char *string, const char *end) {
+	const unsigned char *s;
+
+	s = (const unsigned char *) string;
+
+	while (s != (const unsigned char *) end && (*s & 0x80)) {
+		unsigned char min, max;
+		size_t len, i;
+
+		/* Second bytes are limited to rule out overlong sequences, surrogates and code points past U+10FFFF */
+		min = 0x80;
+		max = 0xBF;
+
+		if (*s >= 0xC2 && *s <= 0xDF) {
+			len = 2;
+		} else if (*s >= 0xE0 && *s <= 0xEF) {
+			len = 3;
+			min = *s == 0xE0 ? 0xA0 : min;
+			max = *s == 0xED ? 0x9F : max;
+		} else if (*s >= 0xF0 && *s <= 0xF4) {
+			len = 4;
+			min = *s == 0xF0 ? 0x90 : min;
+			max = *s == 0xF4 ? 0x8F : max;
+		} else {
+			return NULL;
+		}
+
+		if ((size_t) ((const unsigned char *) end - s) < len || s[1] < min || s[1] > max)
+			return NULL;
+
+		for (i = 2; i < len; ++i)
+			if ((s[i] & 0xC0) != 0x80)
+				return NULL;
+
+		s += len;
+	}
+
+	return (const char *) s;
+}
+
+/* Value of the four hex digits, or -1 if they are not */
+static long read_hex(const char *string, const char *end) {
+	long code;
+	int i;
+
+	if (end - string < 4)
+		return -1;
+
+	for (code = 0, i = 0; i < 4; ++i) {
+		char c;
+
+		c = string[i];
+
+		if (IS_DIGIT(c))
+			code = code * 16 + (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			code = code * 16 + (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			code = code * 16 + (c - 'A' + 10);
+		else
+			return -1;
+	}
+
+	return code;
+}
+
+static size_t encode_utf8(unsigned long code, char *out) {
+	if (code < 0x80) {
+		out[0] = (char) code;
+		return 1;
+	} else if (code < 0x800) {
+		out[0] = (char) (0xC0 | (code >> 6));
+		out[1] = (char) (0x80 | (code & 0x3F));
+		return 2;
+	} else if (code < 0x10000) {
+		out[0] = (char) (0xE0 | (code >> 12));
+		out[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+		out[2] = (char) (0x80 | (code & 0x3F));
+		return 3;
+	}
+
+	out[0] = (char) (0xF0 | (code >> 18));
+	out[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+	out[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+	out[3] = (char) (0x80 | (code & 0x3F));
+	return 4;
+}
+
+/*
+ * Decodes the escape sequences of a scanned string. Since an escape sequence is
+ * never shorter than the character it stands for, not even in UTF-8, out can
+ * point to the string itself.
+ */
+static size_t decode_string(const char *string, const char *end, char *out) {
+	size_t len;
+
+	len = 0;
+
+	while (string != end) {
+		char c;
+
+		if (*string == '\\') {
+			++string;
+
+			if (*string == 'u') {
+				unsigned long code;
+
+				code = (unsigned long) read_hex(string + 1, end);
+				string += 5;
+
+				if (code >= 0xD800 && code <= 0xDBFF) {
+					code = 0x10000 + ((code - 0xD800) << 10) + ((unsigned long) read_hex(string + 2, end) - 0xDC00);
+					string += 6;
+				}
+
+				len += encode_utf8(code, out + len);
+				continue;
+			}
+
+			if (*string == 'n')
+				c = '\n';
+			else if (*string == 'r')
+				c = '\r';
+			else if (*string == 'b')
+				c = '\b';
+			else if (*string == 'f')
+				c = '\f';
+			else if (*string == 't')
+				c = '\t';
+			else
+				c = *string;
+		} else {
+			c = *string;
+		}
+
+		out[len++] = c;
+
+		++string;
+	}
+
+	return len;
+}
+
+/*
+ * The string is scanned for its closing quote first, so that the memory for it
+ * can be taken from the arena in one go, and the unused tail is given back once
+ * it is decoded. In situ strings are decoded over themselves instead, with the
+ * terminator written at the latest over the closing quote.
+ */
+static const char *parse_string(Parser *p, const char *string, String *out) {
+	const char *end;
+	char *val;
+	size_t raw, len;
+	int escaped;
+
+	if (PEEK(p, string) != '\"') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	++string;
+
+	if (!(end = scan_string(p, string, &escaped)))
+		return NULL;
+
+	raw = (size_t) (end - string);
+
+	if (p->insitu) {
+		val = (char *) string;
+	} else {
+		val = parser_alloc(p, raw + 1);
+		if (!val)
+			return NULL;
+	}
+
+	if (escaped) {
+		len = decode_string(string, end, val);
+	} else {
+		if (!p->insitu)
+			memcpy(val, string, raw);
+
+		len = raw;
+	}
+
+	val[len] = '\0';
+
+	if (!p->insitu)
+		arena_shrink(p->arena, val, raw + 1, len + 1);
+		
+	out->chars = val;
+	out->length = len;
+	return end + 1;
+}
+
+/*
+ * Parses a key, taking it from the key table if there is one. Keys the table
+ * does not have, and cannot get because it is frozen, are parsed like strings.
+ * Keys are compared and written as terminated strings, so a key with an
+ * escaped NUL character in it is an invalid string.
+ */
+static const char *parse_key(Parser *p, const char *string, char **out) {
+	const char *end, *key;
+	String str;
+	int escaped;
+
+#ifdef JAYCEON_STATS
+	if (p->stats && !p->counting)
+		return count_key(p, string, out);
+#endif
+
+	if (p->keys) {
+		if (PEEK(p, string) != '\"') {
+			set_error(p, JY_ERROR_SYNTAX, string);
+			return NULL;
+		}
+
+		if (!(end = scan_string(p, string + 1, &escaped)))
+			return NULL;
+
+		if (escaped) {
+			char *buf;
+			size_t base;
+
+			base = p->top;
+
+			if (!(buf = stack_push(p, NULL, (size_t) (end - string - 1))))
+				return NULL;
+
+			key = intern_key(p->keys, buf, decode_string(string + 1, end, buf));
+			p->top = base;
+		} else {
+			key = intern_key(p->keys, string + 1, (size_t) (end - string - 1));
+		}
+
+		if (key) {
+			*out = (char *) key;
+			return end + 1;
+		}
+	}
+
+	if (!(end = parse_string(p, string, &str)))
+		return NULL;
+
+	if (memchr(str.chars, '\0', str.length)) {
+		set_error(p, JY_ERROR_STRING, string);
+		return NULL;
+	}
+
+	*out = str.chars;
+	return end;
+}
+
+/* Records where a string value is in the input, leaving it to jy_is_string */
+static const char *parse_view(Parser *p, const char *string, JYValue *out) {
+	const char *end;
+	View *view;
+	int escaped;
+
+	if (PEEK(p, string) != '\"') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	++string;
+
+	if (!(end = scan_string(p, string, &escaped)))
+		return NULL;
+
+	if ((size_t) (end - string) > INDEX_MAX) {
+		set_error(p, JY_ERROR_TOO_LARGE, string - 1);
+		return NULL;
+	}
+
+	if (!(view = parser_alloc(p, sizeof(View))))
+		return NULL;
+
+	view->chars = string;
+	view->arena = p->arena;
+
+	out->type = escaped ? TYPE_ESCAPED_VIEW : TYPE_VIEW;
+	out->value._view = view;
+	out->length = (Index) (end - string);
+	return end + 1;
+}
+
+/*
+ * Arrays and objects are parsed without recursion. The container being parsed
+ * is kept in e, and the ones it is nested in are saved as frames on the stack,
+ * each one right past the elements it has collected so far, so that closing a
+ * container leaves the frame of the one it is in on top.
+ */
+static const char *parse_container(Parser *p, const char *string, JYValue *out) {
+	Elements e;
+	JYValue val;
+	char *key;
+	size_t base, depth;
+	int object;
+
+	base = p->top;
+	depth = p->depth;
+	key = NULL;
+	object = PEEK(p, string) == '{';
+
+	if (!(string = open_container(p, string, &e)))
+		goto fail;
+
+	for (;;) {
+		char c;
+
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) == (object ? '}' : ']')) {
+			if (!(object ? pop_pairs(p, &e, &val) : pop_values(p, &e, &val)))
+				goto fail;
+
+			++string;
+			--p->depth;
+
+			if (e.base == base) {
+				*out = val;
+				return string;
+			} else {
+				Frame frame;
+
+				p->top = e.base - sizeof(Frame);
+				memcpy(&frame, p->stack + p->top, sizeof(Frame));
+
+				e = frame.e;
+				key = frame.key;
+				object = frame.object;
+			}
+		} else {
+			if (object) {
+				if (!(string = parse_key(p, string, &key)))
+					goto fail;
+
+				string = parse_space(p, string);
+
+				if (PEEK(p, string) != ':')
+					goto fail;
+
+				string = parse_space(p, string + 1);
+			}
+
+			c = PEEK(p, string);
+
+			if ((c == '[' || c == '{') && !p->lazy) {
+				Frame frame;
+
+				frame.e = e;
+				frame.key = key;
+				frame.object = object;
+				frame.expect = EXPECT_COMMA;
+
+				if (!stack_push(p, &frame, sizeof(frame)))
+					goto fail;
+
+				object = c == '{';
+
+				if (!(string = open_container(p, string, &e)))
+					goto fail;
+
+				continue;
+			}
+
+			if (!(string = parse_value(p, string, &val)))
+				goto fail;
+		}
+
+		if (object) {
+			Pair pair;
+
+			pair.key = key;
+			pair.value = val;
+
+			if (!push_element(p, &e, &pair, sizeof(pair)))
+				goto fail;
+		} else if (!push_element(p, &e, &val, sizeof(val))) {
+			goto fail;
+		}
+
+		/* Like the structural index engine, this allows a trailing comma */
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) == ',')
+			++string;
+		else if (PEEK(p, string) != (object ? '}' : ']'))
+			goto fail;
+	}
+
+fail:
+	/* Parsers that return NULL have set the error themselves */
+	set_error(p, JY_ERROR_SYNTAX, string);
+	p->top = base;
+	p->depth = depth;
+	return NULL;
+}
+
+/* Moves into the array or object, if it is not nested too deep */
+static const char *open_container(Parser *p, const char *string, Elements *e) {
+	int object;
+
+	object = *string == '{';
+
+	if (p->depth == p->max_depth) {
+		set_error(p, JY_ERROR_DEPTH, string);
+		return NULL;
+	}
+
+	++p->depth;
+	COUNT_CONTAINER(p, object, p->depth);
+
+	open_elements(p, e, object ? sizeof(Pair) : sizeof(JYValue), object);
+
+	string = parse_space(p, string + 1);
+
+	if (PEEK(p, string) == '\0') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	return string;
+}
+
+/*
+ * The first character of a value always tells its type, so the value is handed
+ * straight to the only parser that can accept it
+ */
+static const char *parse_value(Parser *p, const char *string, JYValue *out) {
+	const char *end;
+	Span *span;
+
+	switch (PEEK(p, string)) {
+		case '[':
+		case '{':
+			if (p->lazy) {
+				if (!(end = skip_container(p, string)))
+					return NULL;
+
+				/* Longer ones are parsed right away, their length would not fit */
+				if ((size_t) (end - string) <= INDEX_MAX) {
+					if (!(span = parser_alloc(p, sizeof(Span))))
+						return NULL;
+
+					span->chars = string;
+					span->doc = p->doc;
+					COUNT_CONTAINER(p, *string == '{', p->depth + 1);
+
+					out->type = *string == '[' ? TYPE_LAZY_ARRAY : TYPE_LAZY_OBJECT;
+					out->value._span = span;
+					out->length = (Index) (end - string);
+					return end;
+				}
+			}
+
+			return parse_container(p, string, out);
+
+		default:
+			return parse_scalar(p, string, out);
+	}
+}
+
+/*
+ * Parses the value at the root, which has to start right at the beginning. The
+ * root itself is never left for later, even in lazy documents.
+ */
+static int parse_root(Parser *p, const char *string, JYValue *out) {
+	const char *end;
+
+	if (PEEK(p, string) == '[' || PEEK(p, string) == '{')
+		end = parse_container(p, string, out);
+	else
+		end = parse_scalar(p, string, out);
+
+#ifdef JAYCEON_STATS
+	if (p->stats && end)
+		p->stats->bytes = (size_t) (end - string);
+#endif
+
+	return end_root(p, string, end) != NULL;
+}
+
+/*
+ * Checks that the root value from string to end is complete. Anything can
+ * follow an array, object or string, but other scalars could go on further.
+ */
+static const char *end_root(Parser *p, const char *string, const char *end) {
+	if (end && *string != '[' && *string != '{' && *string != '\"' && end != p->end && IS_SCALAR(*end)) {
+		set_error(p, JY_ERROR_SYNTAX, end);
+		return NULL;
+	}
+
+	return end;
+}
+
+/*
+ * Skips an array or object of a lazy document by matching brackets. Strings
+ * are scanned like they are during parsing, so that brackets in them do not
+ * count, everything else is only checked once the container is parsed.
+ */
+static const char *skip_container(Parser *p, const char *string) {
+	size_t depth;
+	int escaped;
+
+	depth = 0;
+
+	while (string != p->end) {
+		switch (*string) {
+			case '\"':
+				if (!(string = scan_string(p, string + 1, &escaped)))
+					return NULL;
+
+				break;
+
+			case '[':
+			case '{':
+				/* The nesting is checked as a whole here, parsing it later takes one level at a time */
+				if (++depth > p->max_depth - p->depth) {
+					set_error(p, JY_ERROR_DEPTH, string);
+					return NULL;
+				}
+
+				break;
+
+			case ']':
+			case '}':
+				if (--depth == 0)
+					return string + 1;
+
+				break;
+
+		#ifndef JAYCEON_NO_COMMENT_SUPPORT
+			case '/':
+				/* Comments can contain anything, including brackets */
+				if (parse_space(p, string) != string) {
+					string = parse_space(p, string);
+					continue;
+				}
+
+				break;
+		#endif
+
+			default:
+				break;
+		}
+
+		++string;
+	}
+
+	set_error(p, JY_ERROR_SYNTAX, string);
+	return NULL;
+}
+
+/*
+ * Parses an array or object of a lazy document, leaving the arrays and objects
+ * in it for later in turn. The value is only changed if that succeeds.
+ */
+static int parse_lazy(JYValue *val) {
+	JYDocument *doc;
+	const char *string;
+	Parser p;
+	JYValue res;
+
+	doc = val->value._span->doc;
+	string = val->value._span->chars;
+
+	init_parser(&p, string + val->length, doc->flags, doc->insitu, doc->arena, &doc->arena->allocator);
+	p.doc = doc;
+	p.keys = doc->keys;
+
+	p.max_depth = doc->max_depth;
+	string = parse_container(&p, string, &res);
+
+	if (p.stack != (char *) p.inline_stack)
+		p.allocator->free(p.allocator->user, p.stack);
+
+	/* Whatever it allocated before failing stays in the arena until it is freed */
+	if (!string)
+		return 0;
+
+	*val = res;
+	return 1;
+}
+
+static const char *parse_scalar(Parser *p, const char *string, JYValue *out) {
+	const char *end;
+	String str;
+
+#ifdef JAYCEON_STATS
+	if (p->stats && !p->counting)
+		return count_scalar(p, string, out);
+#endif
+
+	switch (PEEK(p, string)) {
+		case 'n':
+			out->type = TYPE_NULL;
+			end = parse_null(p, string);
+			break;
+
+		case 't':
+		case 'f':
+			out->type = TYPE_BOOL;
+			end = parse_bool(p, string, &out->value._bool);
+			break;
+
+		case '-':
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			end = parse_number(p, string, out);
+			break;
+
+		case '\"':
+			if (p->views)
+				return parse_view(p, string, out);
+
+			if (!(end = parse_string(p, string, &str)))
+				return NULL;
+
+			if (str.length > INDEX_MAX) {
+				set_error(p, JY_ERROR_TOO_LARGE, string);
+				return NULL;
+			}
+
+			out->type = TYPE_STRING;
+			out->value._string = str.chars;
+			out->length = (Index) str.length;
+			return end;
+
+		default:
+			end = NULL;
+			break;
+	}
+
+	/* Numbers and literals are reported from where they start */
+	if (!end)
+		set_error(p, JY_ERROR_SYNTAX, string);
+
+	return end;
+}
+
+/*
+ * The callback parser follows the same grammar as the one building documents,
+ * and uses the same parsers for scalars, but reports every value to the handler
+ * instead of keeping it
+ */
+static const char *sax_value(Parser *p, const char *string) {
+	JYValue val;
+
+	switch (PEEK(p, string)) {
+		case '[':
+		case '{':
+			return sax_container(p, string);
+
+		case '\"':
+			return sax_string(p, string, 0);
+
+		default:
+			if (!(string = parse_scalar(p, string, &val)))
+				return NULL;
+
+			return sax_scalar(p, &val) ? string : NULL;
+	}
+}
+
+/* Reports a value other than a string or container */
+static int sax_scalar(Parser *p, JYValue *val) {
+	const JYHandler *h;
+
+	h = p->handler;
+
+	switch (val->type) {
+		case TYPE_NULL:
+			return !h->null_value || h->null_value(h->user);
+
+		case TYPE_BOOL:
+			return !h->bool_value || h->bool_value(h->user, val->value._bool);
+
+		case TYPE_INTEGER:
+			if (h->integer)
+				return h->integer(h->user, val->value._integer);
+
+			return !h->number || h->number(h->user, (double) val->value._integer);
+
+		default:
+			return !h->number || h->number(h->user, val->value._number);
+	}
+}
+
+/*
+ * Arrays and objects are gone through without recursion, with a bit on the
+ * stack for every one that is open, telling if it is an object, so that the
+ * inline stack is enough for thousands of levels
+ */
+static const char *sax_container(Parser *p, const char *string) {
+	const JYHandler *h;
+	size_t base, depth, level;
+	int object;
+
+	h = p->handler;
+	base = p->top;
+	depth = p->depth;
+	level = 0;
+
+	if (!(string = sax_open(p, string, base, &level)))
+		goto fail;
+
+	for (;;) {
+		char c;
+
+		object = (p->stack[base + (level - 1) / 8] >> ((level - 1) % 8)) & 1;
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) == (object ? '}' : ']')) {
+			if (object ? h->end_object && !h->end_object(h->user) : h->end_array && !h->end_array(h->user))
+				goto fail;
+
+			++string;
+			--p->depth;
+
+			if (--level % 8 == 0)
+				--p->top;
+
+			if (level == 0)
+				return string;
+
+			object = (p->stack[base + (level - 1) / 8] >> ((level - 1) % 8)) & 1;
+		} else {
+			if (object) {
+				if (!(string = sax_string(p, string, 1)))
+					goto fail;
+
+				string = parse_space(p, string);
+
+				if (PEEK(p, string) != ':')
+					goto fail;
+
+				string = parse_space(p, string + 1);
+			}
+
+			c = PEEK(p, string);
+
+			if (c == '[' || c == '{') {
+				if (!(string = sax_open(p, string, base, &level)))
+					goto fail;
+
+				continue;
+			}
+
+			if (!(string = sax_value(p, string)))
+				goto fail;
+		}
+
+		string = parse_space(p, string);
+
+		if (PEEK(p, string) == ',')
+			++string;
+		else if (PEEK(p, string) != (object ? '}' : ']'))
+			goto fail;
+	}
+
+fail:
+	set_error(p, JY_ERROR_SYNTAX, string);
+	p->top = base;
+	p->depth = depth;
+	return NULL;
+}
+
+/*
+ * Reports the start of the array or object, and moves into it, setting its bit
+ * among the ones starting at base
+ */
+static const char *sax_open(Parser *p, const char *string, size_t base, size_t *level) {
+	const JYHandler *h;
+	unsigned char *bits;
+	int object;
+
+	h = p->handler;
+	object = *string == '{';
+
+	if (p->depth == p->max_depth) {
+		set_error(p, JY_ERROR_DEPTH, string);
+		return NULL;
+	}
+
+	if (object ? h->start_object && !h->start_object(h->user) : h->start_array && !h->start_array(h->user))
+		return NULL;
+
+	if (*level % 8 == 0 && !stack_push(p, NULL, 1))
+		return NULL;
+
+	bits = (unsigned char *) p->stack + base + *level / 8;
+
+	if (object)
+		*bits |= (unsigned char) (1u << (*level % 8));
+	else
+		*bits &= (unsigned char) ~(1u << (*level % 8));
+
+	++*level;
+	++p->depth;
+
+	string = parse_space(p, string + 1);
+
+	if (PEEK(p, string) == '\0') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	return string;
+}
+
+/*
+ * Strings without escape sequences are reported right out of the input, others
+ * are decoded onto the stack for the duration of the callback
+ */
+static const char *sax_string(Parser *p, const char *string, int key) {
+	int (*callback)(void *user, const char *str, size_t len);
+	const char *end, *chars;
+	size_t base, len;
+	int escaped, res;
+
+	callback = key ? p->handler->key : p->handler->string;
+
+	if (PEEK(p, string) != '\"') {
+		set_error(p, JY_ERROR_SYNTAX, string);
+		return NULL;
+	}
+
+	++string;
+
+	if (!(end = scan_string(p, string, &escaped)))
+		return NULL;
+
+	if (!callback)
+		return end + 1;
+
+	base = p->top;
+	chars = string;
+	len = (size_t) (end - string);
+
+	if (escaped) {
+		char *buf;
+
+		if (!(buf = stack_push(p, NULL, len)))
+			return NULL;
+
+		len = decode_string(string, end, buf);
+		chars = buf;
+	}
+
+	res = callback(p->handler->user, chars, len);
+
+	p->top = base;
+	return res ? end + 1 : NULL;
+}
+
+/*
+ * Finds the next line that is not blank, and returns where its record starts,
+ * or NULL at the end of the buffer
+ */
+static const char *next_record(JYRecords *records, const char **eol) {
+	const char *string;
+
+	for (;;) {
+		string = records->next;
+
+		if (string == records->end)
+			return NULL;
+
+		++records->lines;
+
+		/* Strings cannot contain a newline, so it always ends the record */
+		*eol = memchr(string, '\n', (size_t) (records->end - string));
+		records->next = *eol ? *eol + 1 : records->end;
+		records->start = string;
+
+		if (!*eol)
+			*eol = records->end;
+
+		while (string != *eol && IS_SPACE(*string))
+			++string;
+
+		if (string != *eol)
+			break;
+	}
+
+	records->line = records->lines;
+	return string;
+}
+
+/* Parses every record of the slice of the worker into its arena */
+static void *run_worker(void *arg) {
+	Worker *w;
+	const char *string, *eol;
+
+	w = arg;
+
+	while ((string = next_record(&w->records, &eol))) {
+		if (w->count == w->capacity) {
+			const JYAllocator *allocator;
+			size_t newcap;
+			Result *newresults;
+
+			allocator = &w->records.allocator;
+			newcap = w->capacity ? w->capacity * 2 : 256;
+
+			newresults = allocator->alloc(allocator->user, newcap * sizeof(Result));
+			if (!newresults) {
+				w->failed = 1;
+				break;
+			}
+
+			if (w->results) {
+				memcpy(newresults, w->results, w->count * sizeof(Result));
+				allocator->free(allocator->user, w->results);
+			}
+
+			w->results = newresults;
+			w->capacity = newcap;
+		}
+
+		w->results[w->count].line = w->records.line;
+		w->results[w->count].doc = parse_document(string, (size_t) (eol - string), &w->records.opts, 0);
+		++w->count;
+	}
+
+	return NULL;
+}
+
+/*
+ * Goes on with the token the parser is in the middle of. The part of it that
+ * is in this chunk starts at start, and scanning it goes on from string.
+ */
+static const char *push_token(JYParser *parser, const char *start, const char *string, const char *end) {
+	const char *stop;
+	int res;
+
+	stop = scan_token(parser, string, end);
+
+	/* Only a slash fails here, which is right before string on the same line */
+	if (parser->status == PUSH_FAILED) {
+		push_error(parser, &parser->pos, parser->chunk, string);
+
+		if (parser->error) {
+			--parser->error->offset;
+			--parser->error->column;
+		}
+
+		return end;
+	}
+
+	if (parser->lex != LEX_STRING && parser->lex != LEX_SCALAR) {
+		/* Nothing of comments has to be kept */
+		if (stop)
+			parser->lex = LEX_NONE;
+
+		return stop ? stop : end;
+	}
+
+	if (!stop || parser->length) {
+		size_t size, needed;
+
+		size = (size_t) ((stop ? stop : end) - start);
+		needed = parser->length + size;
+
+		if (!parser->length && parser->error) {
+			parser->token_pos = parser->pos;
+			count_position(&parser->token_pos, parser->chunk, start);
+		}
+
+		if (needed > parser->token_capacity) {
+			size_t newcap;
+			char *newtoken;
+
+			newcap = parser->token_capacity ? parser->token_capacity * 2 : 64;
+			while (newcap < needed)
+				newcap *= 2;
+
+			newtoken = parser->allocator.alloc(parser->allocator.user, newcap);
+			if (!newtoken) {
+				set_error(&parser->p, JY_ERROR_MEMORY, NULL);
+				parser->status = PUSH_FAILED;
+				push_error(parser, &parser->pos, parser->chunk, start);
+				return end;
+			}
+
+			if (parser->token) {
+				memcpy(newtoken, parser->token, parser->length);
+				parser->allocator.free(parser->allocator.user, parser->token);
+			}
+
+			parser->token = newtoken;
+			parser->token_capacity = newcap;
+		}
+
+		memcpy(parser->token + parser->length, start, size);
+		parser->length = needed;
+
+		if (!stop)
+			return end;
+
+		if (!(res = push_lexeme(parser, parser->token, parser->token + parser->length)))
+			push_error(parser, &parser->token_pos, parser->token, parser->token);
+	} else if (!(res = push_lexeme(parser, start, stop))) {
+		push_error(parser, &parser->pos, parser->chunk, start);
+	}
+
+	parser->lex = LEX_NONE;
+	parser->length = 0;
+
+	if (!res)
+		parser->status = PUSH_FAILED;
+
+	return stop;
+}
+
+/*
+ * Finds the end of the token, or returns NULL if it goes on past the end of the
+ * chunk. A slash that does not start a comment ends a token of its own, which
+ * is never valid.
+ */
+static const char *scan_token(JYParser *parser, const char *string, const char *end) {
+	switch (parser->lex) {
+		case LEX_STRING:
+			for (;;) {
+				if (parser->escape && string != end) {
+					parser->escape = 0;
+					++string;
+				}
+
+				string = parser->p.scan_plain(string, end);
+
+				if (string == end)
+					return NULL;
+				else if (*string == '\"')
+					return string + 1;
+
+				/* Anything else is left to parse_string to reject */
+				parser->escape = *string == '\\';
+				++string;
+			}
+
+		case LEX_SCALAR:
+			while (string != end && IS_SCALAR(*string))
+				++string;
+
+			return string == end ? NULL : string;
+
+		case LEX_SLASH:
+			if (string == end)
+				return NULL;
+
+		#ifndef JAYCEON_NO_COMMENT_SUPPORT
+			if (*string == '/') {
+				parser->lex = LEX_LINE_COMMENT;
+				return scan_token(parser, string + 1, end);
+			} else if (*string == '*') {
+				parser->lex = LEX_BLOCK_COMMENT;
+				return scan_token(parser, string + 1, end);
+			}
+		#endif
+
+			parser->status = PUSH_FAILED;
+			return string;
+
+		case LEX_LINE_COMMENT:
+			string = memchr(string, '\n', (size_t) (end - string));
+			return string ? string + 1 : NULL;
+
+		default:
+			for (; string != end; ++string) {
+				if (parser->escape && *string == '/')
+					return string + 1;
+
+				parser->escape = *string == '*';
+			}
+
+			return NULL;
+	}
+}
+
+/* Parses a string or scalar token, which ends right at end */
+static int push_lexeme(JYParser *parser, const char *string, const char *end) {
+	const char *stop;
+	Parser *p;
+	Frame *top;
+	JYValue val;
+
+	p = &parser->p;
+	p->end = end;
+	top = parser->depth ? &parser->frames[parser->depth - 1] : NULL;
+
+	if (top && top->expect == EXPECT_KEY && *string == '\"') {
+		top->expect = EXPECT_COLON;
+
+		if (p->handler)
+			return sax_string(p, string, 1) == end;
+
+		return parse_key(p, string, &top->key) == end;
+	}
+
+	if (top && top->expect != EXPECT_VALUE && top->expect != EXPECT_ELEMENT)
+		return 0;
+
+	stop = p->handler ? sax_value(p, string) : parse_scalar(p, string, &val);
+
+	/* The rest of the token is where it goes wrong, like for the other engines */
+	if (stop != end) {
+		set_error(p, JY_ERROR_SYNTAX, stop);
+		return 0;
+	}
+
+	return push_value(parser, p->handler ? NULL : &val);
+}
+
+static int push_op(JYParser *parser, char c) {
+	const JYHandler *h;
+	Parser *p;
+	Frame *top;
+	JYValue val;
+
+	p = &parser->p;
+	h = p->handler;
+	top = parser->depth ? &parser->frames[parser->depth - 1] : NULL;
+
+	switch (c) {
+		case '[':
+		case '{':
+			if (top && top->expect != EXPECT_VALUE && top->expect != EXPECT_ELEMENT)
+				return 0;
+
+			if (h && c == '{' && h->start_object && !h->start_object(h->user))
+				return 0;
+
+			if (h && c == '[' && h->start_array && !h->start_array(h->user))
+				return 0;
+
+			if (parser->depth == p->max_depth) {
+				set_error(p, JY_ERROR_DEPTH, NULL);
+				return 0;
+			}
+
+			if (parser->depth == parser->capacity) {
+				size_t newcap;
+				Frame *newframes;
+
+				newcap = parser->capacity ? parser->capacity * 2 : 16;
+
+				newframes = parser->allocator.alloc(parser->allocator.user, newcap * sizeof(Frame));
+				if (!newframes) {
+					set_error(p, JY_ERROR_MEMORY, NULL);
+					return 0;
+				}
+
+				if (parser->frames) {
+					memcpy(newframes, parser->frames, parser->depth * sizeof(Frame));
+					parser->allocator.free(parser->allocator.user, parser->frames);
+				}
+
+				parser->frames = newframes;
+				parser->capacity = newcap;
+			}
+
+			top = &parser->frames[parser->depth++];
+			top->object = c == '{';
+			top->expect = top->object ? EXPECT_KEY : EXPECT_ELEMENT;
+			top->key = NULL;
+			open_elements(p, &top->e, top->object ? sizeof(Pair) : sizeof(JYValue), top->object);
+			return 1;
+
+		case ']':
+		case '}':
+			/* Like the recursive descent engine, this allows a trailing comma */
+			if (!top || top->object != (c == '}'))
+				return 0;
+
+			if (top->expect != EXPECT_COMMA && top->expect != (top->object ? EXPECT_KEY : EXPECT_ELEMENT))
+				return 0;
+
+			if (h) {
+				if (c == '}' && h->end_object && !h->end_object(h->user))
+					return 0;
+
+				if (c == ']' && h->end_array && !h->end_array(h->user))
+					return 0;
+			} else if (top->object) {
+				if (!pop_pairs(p, &top->e, &val))
+					return 0;
+			} else {
+				if (!pop_values(p, &top->e, &val))
+					return 0;
+			}
+
+			--parser->depth;
+			return push_value(parser, h ? NULL : &val);
+
+		case ',':
+			if (!top || top->expect != EXPECT_COMMA)
+				return 0;
+
+			top->expect = top->object ? EXPECT_KEY : EXPECT_ELEMENT;
+			return 1;
+
+		default:
+			if (!top || top->expect != EXPECT_COLON)
+				return 0;
+
+			top->expect = EXPECT_VALUE;
+			return 1;
+	}
+}
+
+/*
+ * Adds a complete value to the innermost container, unless it was reported. A
+ * value outside of any is the root, which completes the input.
+ */
+static int push_value(JYParser *parser, JYValue *val) {
+	Frame *top;
+
+	if (!parser->depth) {
+		if (val)
+			parser->doc->root = *val;
+
+		parser->status = PUSH_DONE;
+		return 1;
+	}
+
+	top = &parser->frames[parser->depth - 1];
+	top->expect = EXPECT_COMMA;
+
+	if (!val)
+		return 1;
+
+	if (top->object) {
+		Pair pair;
+
+		pair.key = top->key;
+		pair.value = *val;
+
+		return push_element(&parser->p, &top->e, &pair, sizeof(pair));
+	}
+
+	return push_element(&parser->p, &top->e, val, sizeof(*val));
+}
+
+/*
+ * Fills in the error of the parser, at where the parser failed if it knows it,
+ * otherwise at. Both are counted from string, whose position is from.
+ */
+static void push_error(JYParser *parser, const JYError *from, const char *string, const char *at) {
+	JYError *error;
+
+	if (!(error = parser->error))
+		return;
+
+	*error = *from;
+	error->code = parser->p.error ? parser->p.error : JY_ERROR_SYNTAX;
+	count_position(error, string, parser->p.error_at ? parser->p.error_at : at);
+}
+
+/*
+ * The pre-scan counts the elements of every container in the order they are
+ * opened in, which is the order the parser gets to them in as well. It only
+ * looks at the characters that start a token, and keeps the indices of the
+ * containers that are still open on the stack. The counts are just a hint, if
+ * the pre-scan cannot finish there are none, and the parser collects elements
+ * on the stack as usual.
+ */
+static void count_elements(Parser *p, const char *string) {
+	size_t capacity;
+	int fresh, res;
+
+	capacity = 0;
+	fresh = 0;
+	res = -1;
+
+	p->containers = 0;
+	p->next_container = 0;
+
+	for (;;) {
+		char c;
+
+		string = parse_space(p, string);
+		if (string == p->end)
+			break;
+
+		c = *string++;
+
+		if ((res = count_token(p, c, &capacity, &fresh)) <= 0)
+			break;
+
+		if (c == '\"') {
+			/* Up to the closing quote, checking the string is left to the parser */
+			for (;;) {
+				string = p->scan_plain(string, p->end);
+
+				if (string == p->end)
+					break;
+				else if (*string++ == '\"')
+					break;
+				else if (string[-1] == '\\' && string != p->end)
+					++string;
+			}
+		} else if (IS_SCALAR(c)) {
+			while (string != p->end && IS_SCALAR(*string))
+				++string;
+		}
+	}
+
+	discard_counts(p, res);
+}
+
+/* Same as count_elements, but walks the structural index instead of the input */
+static void count_indexed(Parser *p) {
+	size_t capacity, i;
+	int fresh, res;
+
+	capacity = 0;
+	fresh = 0;
+	res = -1;
+
+	p->containers = 0;
+	p->next_container = 0;
+
+	for (i = 0; i < p->count; ++i) {
+		if ((res = count_token(p, p->begin[p->index[i]], &capacity, &fresh)) <= 0)
+			break;
+	}
+
+	discard_counts(p, res);
+}
+
+/*
+ * Counts the token starting with c towards the innermost open container, if it
+ * is the first one after the opening bracket or a comma. Returns zero once the
+ * root container is closed, and -1 if the pre-scan cannot go on.
+ */
+static int count_token(Parser *p, char c, size_t *capacity, int *fresh) {
+	size_t *open;
+
+	open = p->top ? (size_t *) (p->stack + p->top) - 1 : NULL;
+
+	if (*fresh && open && c != ']' && c != '}')
+		++p->counts[*open];
+
+	*fresh = 0;
+
+	switch (c) {
+		case '[':
+		case '{':
+			if (p->containers == *capacity) {
+				const JYAllocator *allocator;
+				size_t newcap, *newcounts;
+
+				allocator = p->allocator;
+				newcap = *capacity ? *capacity * 2 : 64;
+
+				newcounts = allocator->alloc(allocator->user, newcap * sizeof(size_t));
+				if (!newcounts)
+					return -1;
+
+				COUNT_MEMORY(p, newcap * sizeof(size_t), *capacity * sizeof(size_t), *capacity != 0);
+
+				if (p->counts) {
+					memcpy(newcounts, p->counts, p->containers * sizeof(size_t));
+					allocator->free(allocator->user, p->counts);
+				}
+
+				p->counts = newcounts;
+				*capacity = newcap;
+			}
+
+			if (!stack_push(p, &p->containers, sizeof(size_t)))
+				return -1;
+
+			p->counts[p->containers++] = 0;
+			*fresh = 1;
+			return 1;
+
+		case ']':
+		case '}':
+			if (!open)
+				return -1;
+
+			p->top -= sizeof(size_t);
+			return p->top ? 1 : 0;
+
+		case ',':
+			*fresh = 1;
+			return 1;
+
+		default:
+			return 1;
+	}
+}
+
+/* Drops the counts unless the pre-scan got to the end of the root */
+static void discard_counts(Parser *p, int res) {
+	if (res != 0 && p->counts) {
+		p->allocator->free(p->allocator->user, p->counts);
+		p->counts = NULL;
+	}
+
+	/* Running out of memory only cuts the pre-scan short */
+	p->error = JY_ERROR_NONE;
+	p->error_at = NULL;
+	p->top = 0;
+}
+
+/*
+ * Takes the count of the next container, and the arena memory for its elements,
+ * along with the hash table in front of them if it is an object that gets one
+ */
+static void open_elements(Parser *p, Elements *e, size_t size, int object) {
+	e->slots = NULL;
+	e->capacity = 0;
+	e->count = 0;
+	e->base = p->top;
+
+	if (p->counts && p->next_container < p->containers) {
+		size_t table;
+
+		e->capacity = p->counts[p->next_container++];
+		table = object ? TABLE_BYTES(hash_size(p, e->capacity)) : 0;
+
+		if (e->capacity && e->capacity <= ((size_t) -1 - table) / size) {
+			e->slots = arena_alloc(p->arena, table + e->capacity * size);
+
+			if (e->slots)
+				e->slots += table;
+		}
+	}
+}
+
+/*
+ * Places an element in the memory counted for it, or on the stack if there is
+ * none. An element past the count fails, the pre-scan and the parser agree on
+ * every input the parser accepts.
+ */
+static int push_element(Parser *p, Elements *e, const void *data, size_t size) {
+	if (!e->slots)
+		return stack_push(p, data, size) != NULL;
+
+	if (e->count == e->capacity)
+		return 0;
+
+	memcpy(e->slots + e->count * size, data, size);
+	++e->count;
+	return 1;
+}
+
+/* Moves the values collected since the array was opened into the arena */
+static int pop_values(Parser *p, Elements *e, JYValue *out) {
+	size_t count;
+
+	out->type = TYPE_ARRAY;
+	out->hashed = 0;
+	out->growable = 0;
+
+	if (e->slots) {
+		out->value._values = (JYValue *) e->slots;
+		out->length = (Index) e->count;
+
+		if (e->count > INDEX_MAX) {
+			set_error(p, JY_ERROR_TOO_LARGE, NULL);
+			return 0;
+		}
+
+		return 1;
+	}
+
+	count = (p->top - e->base) / sizeof(JYValue);
+	out->value._values = NULL;
+	out->length = (Index) count;
+
+	if (count > INDEX_MAX) {
+		set_error(p, JY_ERROR_TOO_LARGE, NULL);
+		p->top = e->base;
+		return 0;
+	}
+
+	if (count) {
+		out->value._values = parser_alloc(p, p->top - e->base);
+		if (!out->value._values) {
+			p->top = e->base;
+			return 0;
+		}
+
+		memcpy(out->value._values, p->stack + e->base, p->top - e->base);
+	}
+
+	p->top = e->base;
+	return 1;
+}
+
+/*
+ * Moves the pairs collected since the object was opened into the arena, sorting
+ * them by their keys on the way. Pairs that were parsed straight into the arena
+ * are sorted there, with scratch space on the stack.
+ */
+static int pop_pairs(Parser *p, Elements *e, JYValue *out) {
+	Pair *pairs, *scratch, *sorted;
+	size_t count, size;
+
+	if (e->slots) {
+		count = e->count;
+		out->value._pairs = (Pair *) e->slots;
+		size = hash_size(p, e->capacity);
+	} else {
+		count = (p->top - e->base) / sizeof(Pair);
+		out->value._pairs = NULL;
+		size = hash_size(p, count);
+	}
+
+	out->type = TYPE_OBJECT;
+	out->length = (Index) count;
+	out->hashed = size != 0;
+	out->growable = 0;
+
+	if (count > INDEX_MAX) {
+		set_error(p, JY_ERROR_TOO_LARGE, NULL);
+		p->top = e->base;
+		return 0;
+	}
+
+	if (count) {
+		if (e->slots) {
+			pairs = out->value._pairs;
+			scratch = stack_push(p, NULL, count * sizeof(Pair));
+		} else {
+			pairs = (Pair *) (p->stack + e->base);
+			scratch = parser_alloc(p, TABLE_BYTES(size) + count * sizeof(Pair));
+
+			if (scratch)
+				scratch = (Pair *) ((char *) scratch + TABLE_BYTES(size));
+
+			out->value._pairs = scratch;
+		}
+
+		if (!scratch) {
+			p->top = e->base;
+			return 0;
+		}
+
+		/* Duplicate keys not permitted */
+		if (!(sorted = sort_pairs(pairs, scratch, count, 0))) {
+			set_error(p, JY_ERROR_DUPLICATE_KEY, NULL);
+			p->top = e->base;
+			return 0;
+		}
+
+		if (sorted != out->value._pairs)
+			memcpy(out->value._pairs, sorted, count * sizeof(Pair));
+
+		if (size)
+			hash_pairs(out, size);
+	}
+
+	p->top = e->base;
+	return 1;
+}
+
+/*
+ * Sorts the pairs, using scratch space for as many of them, and returns which of
+ * the two ends up holding them. Pairs which are already sorted are left alone,
+ * otherwise runs of them are insertion sorted and merged. Two equal keys always
+ * get compared somewhere along the way, in which case NULL is returned, unless
+ * duplicates are allowed, which are then kept in the order they were in.
+ */
+static Pair *sort_pairs(Pair *pairs, Pair *scratch, size_t count, int duplicates) {
+	Pair *src, *dst;
+	size_t width, i;
+	int res;
+
+	res = 1;
+
+	for (i = 1; i < count; ++i) {
+		if ((res = COMPARE_KEYS(pairs[i - 1].key, pairs[i].key)) > 0 || (res == 0 && !duplicates))
+			break;
+	}
+
+	if (i == count)
+		return pairs;
+	else if (res == 0)
+		return NULL;
+
+	for (i = 0; i < count; i += SORT_RUN) {
+		size_t end, j;
+
+		end = count - i < SORT_RUN ? count : i + SORT_RUN;
+
+		for (j = i + 1; j < end; ++j) {
+			Pair pair;
+			size_t k;
+
+			pair = pairs[j];
+			res = 1;
+
+			for (k = j; k > i && (res = COMPARE_KEYS(pair.key, pairs[k - 1].key)) < 0; --k)
+				pairs[k] = pairs[k - 1];
+
+			if (res == 0 && !duplicates)
+				return NULL;
+
+			pairs[k] = pair;
+		}
+	}
+
+	src = pairs;
+	dst = scratch;
+
+	for (width = SORT_RUN; width < count; width *= 2) {
+		Pair *tmp;
+
+		for (i = 0; i < count; i += 2 * width) {
+			size_t l, lend, r, rend, k;
+
+			l = k = i;
+			lend = count - i < width ? count : i + width;
+			r = lend;
+			rend = count - lend < width ? count : lend + width;
+
+			while (l < lend && r < rend) {
+				res = COMPARE_KEYS(src[l].key, src[r].key);
+
+				if (res == 0 && !duplicates)
+					return NULL;
+
+				dst[k++] = res <= 0 ? src[l++] : src[r++];
+			}
+
+			while (l < lend)
+				dst[k++] = src[l++];
+
+			while (r < rend)
+				dst[k++] = src[r++];
+		}
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	return src;
+}
+
+/* Binary searches sorted pairs for the key */
+static Pair *find_pair(Pair *pairs, size_t count, const char *key) {
+	ptrdiff_t l, r, m;
+	int res;
+
+	l = 0, r = (ptrdiff_t) count - 1;
+	while (l <= r) {
+		m = (l + r) / 2;
+		res = COMPARE_KEYS(key, pairs[m].key);
+
+		if (res > 0) {
+			l = m + 1;
+		} else if (res < 0) {
+			r = m - 1;
+		} else {
+			return &pairs[m];
+		}
+	}
+
+	return NULL;
+}
+
+/* Looks the key up in the object, the hash is only used if it has a table */
+static JYValue *find_value(JYObject *obj, const char *key, unsigned long hash) {
+	Pair *pairs;
+
+	if (obj->val.type == TYPE_SNAPSHOT_OBJECT)
+		return find_entry(obj, key, hash);
+
+	if (!merge_pairs(&obj->val))
+		return NULL;
+
+	pairs = obj->val.value._pairs;
+
+	if (obj->val.hashed) {
+		Index *slots, mask, slot;
+		size_t i;
+
+		mask = ((Index *) pairs)[-1];
+		slots = (Index *) pairs - 1 - ((size_t) mask + 1);
+
+		for (i = hash & mask; (slot = slots[i]); i = (i + 1) & mask)
+			if (!COMPARE_KEYS(key, pairs[slot - 1].key))
+				return &pairs[slot - 1].value;
+
+		return NULL;
+	}
+
+	pairs = find_pair(pairs, obj->val.length, key);
+	return pairs ? &pairs->value : NULL;
+}
+
+/* Same as find_value, for the entries of a snapshot object */
+static JYValue *find_entry(JYObject *obj, const char *key, unsigned long hash) {
+	Entry *entries;
 	ptrdiff_t l, r, m;
 	int res;
 
-	l = 0, r = (ptrdiff_t) obj->count - 1;
+	entries = (Entry *) SNAPSHOT_DATA(&obj->val);
+
+	if (obj->val.hashed) {
+		Index *slots, mask, slot;
+		size_t i;
+
+		mask = ((Index *) entries)[-1];
+		slots = (Index *) entries - 1 - ((size_t) mask + 1);
+
+		for (i = hash & mask; (slot = slots[i]); i = (i + 1) & mask)
+			if (!strcmp(key, (char *) &entries[slot - 1] + entries[slot - 1].key))
+				return &entries[slot - 1].value;
+
+		return NULL;
+	}
+
+	l = 0, r = (ptrdiff_t) obj->val.length - 1;
 	while (l <= r) {
 		m = (l + r) / 2;
-		res = strcmp(key, obj->pairs[m].key);
+		res = strcmp(key, (char *) &entries[m] + entries[m].key);
 
 		if (res > 0) {
 			l = m + 1;
 		} else if (res < 0) {
 			r = m - 1;
 		} else {
-			return &obj->pairs[m].value;
+			return &entries[m].value;
 		}
 	}
 
 	return NULL;
 }
 
-JYValue *jy_index_i(JYArray *obj, size_t key) {
-	if (obj->count < key)
-		return NULL;
-
-	return &obj->values[key];
-}
-
-JYValue *jy_index_i_obj(JYObject *obj, size_t index, const char **out_key) {
-	if (obj->count < index)
-		return NULL;
-	
-	*out_key = (const char *) obj->pairs[index].key;
-	return &obj->pairs[index].value;
-}
-
-/* Type checks */
-int jy_is_null(JYValue *val) {
-	return val->type == TYPE_NULL;
-}
-
-int jy_is_bool(JYValue *val, int *out) {
-	if (val->type != TYPE_BOOL)
-		return 0;
-	
-	*out = val->value._bool;
-	return 1;
-}
-
-int jy_is_number(JYValue *val, double *out) {
-	if (val->type != TYPE_NUMBER)
-		return 0;
-	
-	*out = val->value._number;
-	return 1;
-}
+/* The values of an array, wherever they are kept */
+static JYValue *array_values(JYValue *arr) {
+	if (arr->type == TYPE_SNAPSHOT_ARRAY)
+		return (JYValue *) SNAPSHOT_DATA(arr);
 
-int jy_is_string(JYValue *val, const char **out) {
-	if (val->type != TYPE_STRING)
-		return 0;
-	
-	*out = (const char *) val->value._string;
-	return 1;
+	return arr->value._values;
 }
 
-int jy_is_array(JYValue *val, JYArray **out) {
-	if (val->type != TYPE_ARRAY)
-		return 0;
-	
-	*out = &val->value._array;
-	return 1;
-}
+/*
+ * Size of the hash table an object of as many pairs gets, at least twice as big
+ * as its pair count, or zero if it gets none
+ */
+static size_t hash_size(Parser *p, size_t count) {
+	size_t size;
 
-int jy_is_object(JYValue *val, JYObject **out) {
-	if (val->type != TYPE_OBJECT)
+	if (!p->hash || count < JAYCEON_HASH_MIN_PAIRS || count > INDEX_MAX / 4)
 		return 0;
-	
-	*out = &val->value._object;
-	return 1;
-}
 
-#ifndef NDEBUG
-static void print_string(const char *str);
-static void print_array(JYArray *arr);
-static void print_object(JYObject *obj);
-static void print_value(JYValue *val);
+	for (size = 1; size < count * 2; size *= 2)
+		;
 
-/* Serialization? */
-void jy_print(JYDocument *doc) {
-	print_object(&doc->root);
-	printf("\n");
+	return size;
 }
 
-static void print_string(const char *str) {
-	printf("\"");
-
-	while (*str) {
-		if (*str == '\"' || *str == '\\')
-			printf("\\%c", *str);
-		else if (*str == '\n')
-			printf("\\n");
-		else if (*str == '\r')
-			printf("\\r");
-		else if (*str == '\b')
-			printf("\\b");
-		else if (*str == '\f')
-			printf("\\f");
-		else if (*str == '\t')
-			printf("\\t");
-		else
-			printf("%c", *str);
+/* Fills the hash table that was left room for in front of the pairs */
+static void hash_pairs(JYValue *obj, size_t size) {
+	Pair *pairs;
+	Index *slots;
+	size_t i;
 
-		++str;
-	}
+	pairs = obj->value._pairs;
+	slots = (Index *) pairs - 1 - size;
 
-	printf("\"");
-}
+	memset(slots, 0, size * sizeof(Index));
+	slots[size] = (Index) (size - 1);
 
-static void print_array(JYArray *arr) {
-	size_t i;
+	for (i = 0; i < obj->length; ++i) {
+		size_t slot;
 
-	printf("[");
-	for (i = 0; i < arr->count; ++i) {
-		print_value(&arr->values[i]);
-		if (i != arr->count - 1)
-			printf(",");
-	}
-	printf("]");
-}
+		slot = hash_key(pairs[i].key) & (size - 1);
 
-static void print_object(JYObject *obj) {
-	size_t i;
+		while (slots[slot])
+			slot = (slot + 1) & (size - 1);
 
-	printf("{");
-	for (i = 0; i < obj->count; ++i) {
-		print_string(obj->pairs[i].key);
-		printf(":");
-		print_value(&obj->pairs[i].value);
-		
-		if (i != obj->count - 1)
-			printf(",");
+		slots[slot] = (Index) (i + 1);
 	}
-	printf("}");
-}
-
-static void print_value(JYValue *val) {
-	if (val->type == TYPE_NULL)
-		printf("null");
-	else if (val->type == TYPE_BOOL)
-		printf("%s", val->value._bool ? "true" : "false");
-	else if (val->type == TYPE_NUMBER)
-		printf("%f", val->value._number);
-	else if (val->type == TYPE_STRING)
-		print_string(val->value._string);
-	else if (val->type == TYPE_ARRAY)
-		print_array(&val->value._array);
-	else if (val->type == TYPE_OBJECT)
-		print_object(&val->value._object);
 }
-#endif /* NDEBUG */
 
-static const char *parse_space(const char *string) {
-	while (*string) {
-		if (!isspace(*string)) {
-		#ifndef JAYCEON_NO_COMMENT_SUPPORT
-			if (string[0] == '/' && string[1] == '/') {
-				string += 2;
-
-				while (*string && *string != '\n')
-					++string;
-			} else if (string[0] == '/' && string[1] == '*') {
-				string += 2;
+/* FNV-1a */
+static unsigned long hash_key(const char *key) {
+	unsigned long hash;
 
-				while (*string) {
-					if (string[0] == '*' && string[1] == '/') {
-						string += 2;
-						break;
-					}
+	hash = 2166136261ul;
 
-					++string;
-				}
-			} else {
-		#endif
-				break;
-		#ifndef JAYCEON_NO_COMMENT_SUPPORT
-			}
-		#endif
-		} else {
-			++string;
-		}
+	while (*key) {
+		hash ^= (unsigned char) *key++;
+		hash *= 16777619ul;
 	}
 
-	return string;
-}
-
-static const char *parse_null(const char *string) {
-	int i;
-
-	for (i = 0; i < 4; ++i)
-		if (string[i] != "null"[i])
-			return NULL;
-
-	return string + 4;
+	return hash;
 }
 
-static const char *parse_bool(const char *string, int *out) {
-	const char *word;
-	int val;
-
-	word = *string == 't' ? "true" : "false";
+/* Finds the key in the table, adding a copy of it unless the table is frozen */
+static const char *intern_key(JYKeyTable *table, const char *chars, size_t length) {
+	unsigned long hash;
+	size_t i;
+	char *copy;
 
-	val = *word == 't';
+	hash = 2166136261ul;
 
-	while (*word) {
-		if (*word != *string)
-			return NULL;
-		
-		++word, ++string;
+	for (i = 0; i < length; ++i) {
+		hash ^= (unsigned char) chars[i];
+		hash *= 16777619ul;
 	}
 
-	*out = val;
-	return string;
-}
+	if (table->slots) {
+		for (i = hash & table->mask; table->slots[i].chars; i = (i + 1) & table->mask) {
+			Key *key;
 
-static const char *parse_number(const char *string, double *out) {
-	int sign;
-	double val;
+			key = &table->slots[i];
 
-	if (*string == '-') {
-		++string;
-		sign = 1;
-	} else {
-		sign = 0;
+			if (key->hash == hash && key->length == length && !memcmp(key->chars, chars, length))
+				return key->chars;
+		}
 	}
 
-	val = 0.0;
-
-	if (*string == '0') {
-		++string;
-	} else {
-		while (*string >= '0' && *string <= '9') {
-			val = val * 10.0 + (double) (*string - '0');
-
-			++string;
-		}
+	/* Keys with a NUL in them would not be equal to themselves as strings */
+	if (table->frozen || memchr(chars, '\0', length))
+		return NULL;
 
-		if (!string || val == 0.0)
+	if ((table->count + 1) * 2 > (table->slots ? table->mask + 1 : 0)) {
+		if (!grow_keys(table))
 			return NULL;
+
+		for (i = hash & table->mask; table->slots[i].chars; i = (i + 1) & table->mask)
+			;
 	}
 
-	if (*string == '.') {
-		double frac;
+	if (!(copy = arena_alloc(table->arena, length + 1)))
+		return NULL;
 
-		++string;
+	memcpy(copy, chars, length);
+	copy[length] = '\0';
 
-		if (*string < '0' || *string > '9')
-			return NULL;
+	table->slots[i].chars = copy;
+	table->slots[i].length = length;
+	table->slots[i].hash = hash;
+	++table->count;
 
-		frac = 1.0;
+	return copy;
+}
 
-		while (*string >= '0' && *string <= '9') {
-			frac *= 0.1;
-			val += (double) (*string - '0') * frac;
+/* Doubles the slots of the table, starting with 64 of them */
+static int grow_keys(JYKeyTable *table) {
+	JYAllocator *allocator;
+	Key *slots;
+	size_t size, i;
 
-			++string;
-		}
-	}
+	allocator = &table->arena->allocator;
+	size = table->slots ? (table->mask + 1) * 2 : 64;
 
-	if (*string == 'e' || *string == 'E') {
-		int sign;
-		int exp;
+	if (size > (size_t) -1 / sizeof(Key) || !(slots = allocator->alloc(allocator->user, size * sizeof(Key))))
+		return 0;
 
-		++string;
+	for (i = 0; i < size; ++i)
+		slots[i].chars = NULL;
 
-		if (*string == '+')
-			sign = 0;
-		else if (*string == '-')
-			sign = 1;
-		else
-			return NULL;
+	if (table->slots) {
+		for (i = 0; i <= table->mask; ++i) {
+			size_t j;
 
-		++string;
-		
-		if (*string < '0' || *string > '9')
-			return NULL;
+			if (!table->slots[i].chars)
+				continue;
 
-		exp = 0.0;
+			for (j = table->slots[i].hash & (size - 1); slots[j].chars; j = (j + 1) & (size - 1))
+				;
 
-		while (*string >= '0' && *string <= '9') {
-			exp = exp * 10 + *string - '0';
-			++string;
+			slots[j] = table->slots[i];
 		}
 
-		if (sign)
-			exp *= -1;
-		
-		val = pow10(val, exp);
+		allocator->free(allocator->user, table->slots);
 	}
 
-	if (sign)
-		val *= -1.0;
-
-	*out = val;
-	return string;
+	table->slots = slots;
+	table->mask = size - 1;
+	return 1;
 }
 
 /*
- * NOTE: The current string implementation rejects strings that contain \uXXXX
- * escape sequences.
+ * The structural index engine works in two stages. The first one classifies
+ * the input a block at a time, works out which characters are inside strings,
+ * and records the position of every character that means something to the
+ * grammar: brackets, colons and commas outside of strings, opening quotes, and
+ * the first character of every other scalar. The second stage walks those
+ * positions to build the tree, handing scalars to the same parsers the
+ * recursive descent engine uses.
  */
-static const char *parse_string(const char *string, char **out) {
-	char *val;
-	size_t cap, len;
+static int index_structurals(Parser *p, const char *buf, size_t len) {
+	const unsigned long ALL = 0xFFFFFFFFul;
+	unsigned long escaped, carry, in_string, separated;
+	size_t pos, capacity;
+	const JYAllocator *allocator;
 
-	const size_t GROWTH = JAYCEON_STRING_GROWTH;
+	allocator = p->allocator;
 
-	if (*string != '\"')
-		return NULL;
+	capacity = len / 8 + BLOCK_SIZE;
+	p->index = allocator->alloc(allocator->user, capacity * sizeof(Index));
+	if (!p->index)
+		return INDEX_FAILED;
 
-	++string;
+	COUNT_MEMORY(p, capacity * sizeof(Index), 0, 0);
 
-	val = NULL;
-	cap = len = 0;
+	p->count = 0;
+	escaped = in_string = 0;
+	separated = 1;
 
-	while (*string != '\"') {
-		char c;
+	for (pos = 0; pos < len; pos += BLOCK_SIZE) {
+		const char *block;
+		char tail[BLOCK_SIZE];
+		unsigned long bits, quote, inside, structural;
+		Masks masks;
 
-		if (*string == '\n' || *string == '\0') {
-			free(val);
-			return NULL;
-		} else if (*string == '\\') {
-			++string;
+		block = buf + pos;
 
-			if (*string == 'n') {
-				c = '\n';
-			} else if (*string == 'r') {
-				c = '\r';
-			} else if (*string == 'b') {
-				c = '\b';
-			} else if (*string == 'f') {
-				c = '\f';
-			} else if (*string == 't') {
-				c = '\t';
-			} else if (*string == '\"' || *string == '\\' || *string == '/') {
-				c = *string;
-			} else {
-				free(val);
-				return NULL;
-			}
-		} else {
-			c = *string;
+		if (len - pos < BLOCK_SIZE) {
+			memset(tail, ' ', BLOCK_SIZE);
+			memcpy(tail, block, len - pos);
+			block = tail;
 		}
 
-		if (len == cap) {
-			size_t newcap;
-			char *newval;
-
-			newcap = cap + GROWTH;
-			newval = realloc(val, newcap);
-			if (!newval) {
-				free(val);
-				return NULL;
-			}
-
-			cap = newcap;
-			val = newval;
-		}
+		p->classify(block, &masks);
 
-		val[len++] = c;
+		/*
+		 * A backslash escapes the next character, unless it is escaped itself.
+		 * Masks may be only BLOCK_SIZE bits wide, so one that escapes the
+		 * first character of the next block is carried separately
+		 */
+		carry = 0;
 
-		++string;
-	}
+		for (bits = masks.backslash; bits; bits &= bits - 1) {
+			unsigned long bit;
 
-	if (cap == len) {
-		size_t newcap;
-		char *newval;
-		
-		newcap = cap + 1;
-		newval = realloc(val, newcap);
-		if (!newval) {
-			free(val);
-			return NULL;
+			bit = bits & (~bits + 1);
+			if (!(escaped & bit)) {
+				escaped |= (bit << 1) & ALL;
+				carry = bit >> (BLOCK_SIZE - 1);
+			}
 		}
 
-		cap = newcap;
-		val = newval;
-	}
-
-	val[len] = '\0';
-
-	do {
-		char *newval;
-		
-		newval = realloc(val, len + 1);
-		if (newval)
-			val = newval;
-	} while (0);
+		quote = masks.quote & ~escaped;
+		escaped = carry;
+
+		/* Every unescaped quote flips between the inside and outside of a string */
+		inside = quote;
+		inside ^= inside << 1;
+		inside ^= inside << 2;
+		inside ^= inside << 4;
+		inside ^= inside << 8;
+		inside ^= inside << 16;
+		inside = (inside ^ (in_string ? ALL : 0)) & ALL;
+		in_string = (inside >> (BLOCK_SIZE - 1)) & 1;
+
+		if (masks.slash & ~inside) {
+			/* Comments are left to the recursive descent engine */
+			return INDEX_UNSUPPORTED;
+		}
 
-	++string;
-	*out = val;
-	return string;
-}
+		/* Scalars start after whitespace, an operator or a closing quote */
+		bits = masks.op | masks.space | quote;
+		structural = (masks.op & ~inside) |
+			(quote & inside) |
+			(~(bits | inside) & ((bits << 1) | separated) & ALL);
+		separated = (bits >> (BLOCK_SIZE - 1)) & 1;
 
-static const char *parse_array(const char *string, JYArray *out) {
-	const size_t GROWTH = JAYCEON_ARRAY_GROWTH;
+		if (capacity - p->count < BLOCK_SIZE) {
+			Index *newindex;
+			size_t newcap;
 
-	if (*string != '[') {
-		return NULL;
-	}
+			newcap = capacity * 2;
+			newindex = allocator->alloc(allocator->user, newcap * sizeof(Index));
+			if (!newindex)
+				return INDEX_FAILED;
 
-	++string;
+			COUNT_MEMORY(p, newcap * sizeof(Index), capacity * sizeof(Index), 1);
 
-	out->values = NULL;
-	out->capacity = out->count = 0;
+			memcpy(newindex, p->index, p->count * sizeof(Index));
+			allocator->free(allocator->user, p->index);
 
-	string = parse_space(string);
+			p->index = newindex;
+			capacity = newcap;
+		}
 
-	if (*string == '\0') {
-		return NULL;
+		for (; structural; structural &= structural - 1)
+			p->index[p->count++] = (Index) (pos + first_bit(structural));
 	}
 
-	while (*string != ']') {
-		JYValue res;
+	p->next = 0;
+	return INDEX_OK;
+}
 
-		if (!(string = parse_value(string, &res))) {
-			free_array(out);
-			return NULL;
-		}
+/* Next structural position, or the end of the input past the last one */
+static const char *next_structural(Parser *p) {
+	if (p->next == p->count)
+		return p->end;
 
-		if (out->count == out->capacity) {
-			size_t newcap;
-			JYValue *newvals;
-			
-			newcap = out->capacity + GROWTH;
-			newvals = realloc(out->values, sizeof(JYValue) * newcap);
-			if (!newvals) {
-				free_value(&res);
-				free_array(out);
-				return NULL;
-			}
+	return p->begin + p->index[p->next++];
+}
 
-			out->capacity = newcap;
-			out->values = newvals;
-		}
+/* Moves past the next structural character if it is c */
+static int skip_structural(Parser *p, char c) {
+	if (p->next == p->count || p->begin[p->index[p->next]] != c)
+		return 0;
 
-		out->values[out->count++] = res;
+	++p->next;
+	return 1;
+}
 
-		string = parse_space(string);
-		
-		if (*string == ',') {
-			++string;
-		} else if (*string != ']') {
-			free_array(out);
-			return NULL;
-		}
+/*
+ * Builds the array or object whose opening bracket was just taken, without
+ * recursion, the same way parse_container does
+ */
+static int build_container(Parser *p, char c, JYValue *out) {
+	const char *string;
+	Elements e;
+	JYValue val;
+	char *key;
+	size_t base, depth;
+	int object;
 
-		string = parse_space(string);
-	}
+	base = p->top;
+	depth = p->depth;
+	key = NULL;
+	object = c == '{';
+	string = NULL;
 
-	return ++string;
-}
+	if (!open_indexed(p, object, &e))
+		goto fail;
 
-static const char *parse_object(const char *string, JYObject *out) {
-	const size_t GROWTH = JAYCEON_OBJECT_GROWTH;
+	for (;;) {
+		if (skip_structural(p, object ? '}' : ']')) {
+			string = p->begin + p->index[p->next - 1];
 
-	if (*string != '{')
-		return NULL;
-	
-	++string;
+			if (!(object ? pop_pairs(p, &e, &val) : pop_values(p, &e, &val)))
+				goto fail;
 
-	out->pairs = NULL;
-	out->capacity = out->count = 0;
+			--p->depth;
 
-	string = parse_space(string);
+			if (e.base == base) {
+				*out = val;
+				return 1;
+			} else {
+				Frame frame;
 
-	if (*string == '\0') {
-		return NULL;
-	}
+				p->top = e.base - sizeof(Frame);
+				memcpy(&frame, p->stack + p->top, sizeof(Frame));
 
-	while (*string != '}') {
-		char *key;
-		JYValue val;
+				e = frame.e;
+				key = frame.key;
+				object = frame.object;
+			}
+		} else {
+			if (object) {
+				if (!parse_key(p, string = next_structural(p), &key))
+					goto fail;
 
-		if (!(string = parse_string(string, &key))) {
-			free_object(out);
-			return NULL;
-		}
+				string = next_structural(p);
 
-		string = parse_space(string);
+				if (PEEK(p, string) != ':')
+					goto fail;
+			}
 
-		if (*string != ':') {
-			free(key);
-			free_object(out);
-			return NULL;
-		}
+			string = next_structural(p);
+			c = PEEK(p, string);
 
-		++string;
+			if (c == '[' || c == '{') {
+				Frame frame;
 
-		string = parse_space(string);
-		
-		if (!(string = parse_value(string, &val))) {
-			free(key);
-			free_object(out);
-			return NULL;
-		}
+				frame.e = e;
+				frame.key = key;
+				frame.object = object;
+				frame.expect = EXPECT_COMMA;
 
-		if (out->count == out->capacity) {
-			size_t newcap;
-			Pair *newpairs;
-			
-			newcap = out->capacity + GROWTH;
-			newpairs = realloc(out->pairs, sizeof(Pair) * newcap);
-			if (!newpairs) {
-				free(key);
-				free_value(&val);
-				free_object(out);
-				return NULL;
-			}
+				if (!stack_push(p, &frame, sizeof(frame)))
+					goto fail;
 
-			out->capacity = newcap;
-			out->pairs = newpairs;
-		}
+				object = c == '{';
 
-		do {
-			ptrdiff_t l, r, m;
+				if (!open_indexed(p, object, &e))
+					goto fail;
 
-			l = 0, r = (ptrdiff_t) out->count - 1;
-			while (l <= r) {
-				int res;
+				continue;
+			}
 
-				m = (l + r) / 2;
-				res = strcmp(key, out->pairs[m].key);
+			/* Anything after a scalar is a structural character as well */
+			string = parse_scalar(p, string, &val);
 
-				if (res > 0) {
-					l = m + 1;
-				} else if (res < 0 ) {
-					r = m - 1;
-				} else {
-					/* Duplicate keys not permitted */
-					free(key);
-					free_value(&val);
-					free_object(out);
-					return NULL;
-				}
-			}
+			if (!string || !(string == p->end || IS_SPACE(*string) || (*string && strchr("{}[]:,", *string))))
+				goto fail;
+		}
 
-			memmove(out->pairs + l + 1, out->pairs + l, (out->count++ - (size_t) l) * sizeof(Pair));
+		if (object) {
+			Pair pair;
 
-			out->pairs[l].key = key;
-			out->pairs[l].value = val;
-		} while (0);
+			pair.key = key;
+			pair.value = val;
 
-		string = parse_space(string);
-		
-		if (*string == ',') {
-			++string;
-		} else if (*string != '}') {
-			free_object(out);
-			return NULL;
+			if (!push_element(p, &e, &pair, sizeof(pair)))
+				goto fail;
+		} else if (!push_element(p, &e, &val, sizeof(val))) {
+			goto fail;
 		}
 
-		string = parse_space(string);
+		/* Like the recursive descent engine, this allows a trailing comma */
+		if (!skip_structural(p, ',') && (p->next == p->count || p->begin[p->index[p->next]] != (object ? '}' : ']'))) {
+			string = p->next == p->count ? p->end : p->begin + p->index[p->next];
+			goto fail;
+		}
 	}
 
-	return ++string;
+fail:
+	set_error(p, JY_ERROR_SYNTAX, string);
+	p->top = base;
+	p->depth = depth;
+	return 0;
 }
 
-static const char *parse_value(const char *string, JYValue *out) {
-	const char *tmp;
+/* Same as open_container, once the opening bracket has been taken */
+static int open_indexed(Parser *p, int object, Elements *e) {
+	if (p->depth == p->max_depth) {
+		set_error(p, JY_ERROR_DEPTH, p->begin + p->index[p->next - 1]);
+		return 0;
+	}
 
-	if ((tmp = parse_null(string)))
-		out->type = TYPE_NULL;
-	else if ((tmp = parse_bool(string, &out->value._bool)))
-		out->type = TYPE_BOOL;
-	else if ((tmp = parse_number(string, &out->value._number)))
-		out->type = TYPE_NUMBER;
-	else if ((tmp = parse_string(string, &out->value._string)))
-		out->type = TYPE_STRING;
-	else if ((tmp = parse_array(string, &out->value._array)))
-		out->type = TYPE_ARRAY;
-	else if ((tmp = parse_object(string, &out->value._object)))
-		out->type = TYPE_OBJECT;
+	++p->depth;
+	COUNT_CONTAINER(p, object, p->depth);
 
-	return tmp;
+	open_elements(p, e, object ? sizeof(Pair) : sizeof(JYValue), object);
+	return 1;
 }
 
-static void free_value(JYValue *val) {
-	if (val->type == TYPE_STRING)
-		free(val->value._string);
-	else if (val->type == TYPE_ARRAY)
-		free_array(&val->value._array);
-	else if (val->type == TYPE_OBJECT)
-		free_object(&val->value._object);
-}
+/*
+ * Parses the root value with the structural index engine, returns
+ * INDEX_UNSUPPORTED if the input has to go through the recursive descent one
+ */
+static int parse_indexed(Parser *p, const char *buf, size_t len, JYValue *out) {
+	int res;
 
-static void free_array(JYArray *array) {
-	size_t i;
+	if (len > INDEX_MAX)
+		return INDEX_UNSUPPORTED;
 
-	for (i = 0; i < array->count; ++i)
-		free_value(&array->values[i]);
-	free(array->values);
-}
+	p->begin = buf;
 
-static void free_object(JYObject *object) {
-	size_t i;
+	res = index_structurals(p, buf, len);
+
+	if (res == INDEX_FAILED) {
+		set_error(p, JY_ERROR_MEMORY, buf);
+	} else if (res == INDEX_OK) {
+		/* Like jy_parse, the root has to start right at the beginning */
+		if (p->count == 0 || p->index[0] != 0) {
+			set_error(p, JY_ERROR_SYNTAX, buf);
+			res = INDEX_FAILED;
+		} else if (*buf == '[' || *buf == '{') {
+			if (p->prescan)
+				count_indexed(p);
+
+			p->next = 1;
+			res = build_container(p, *buf, out) ? INDEX_OK : INDEX_FAILED;
 
-	for (i = 0; i < object->count; ++i) {
-		free(object->pairs[i].key);
-		free_value(&object->pairs[i].value);
+		#ifdef JAYCEON_STATS
+			if (p->stats && res == INDEX_OK)
+				p->stats->bytes = (size_t) p->index[p->next - 1] + 1;
+		#endif
+		} else {
+			res = parse_root(p, buf, out) ? INDEX_OK : INDEX_FAILED;
+		}
 	}
 
-	free(object->pairs);
+	if (p->index)
+		p->allocator->free(p->allocator->user, p->index);
+
+	p->index = NULL;
+	return res;
 }
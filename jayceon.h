@@ -33,6 +33,18 @@
 
 #include <stddef.h>
 
+/** @brief Signed integer of 64 bits (of a long, if the compiler has none) */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#include <stdint.h>
+typedef int64_t JYInt64;
+#elif defined(_MSC_VER)
+typedef __int64 JYInt64;
+#elif defined(__GNUC__)
+__extension__ typedef long long JYInt64;
+#else
+typedef long JYInt64;
+#endif
+
 /** @brief Generic JSON value, accessed using jy_is_* functions */
 typedef struct JYValue_ JYValue;
 /** @brief Object representing a JSON array */
@@ -41,28 +53,835 @@ typedef struct JYArray_ JYArray;
 typedef struct JYObject_ JYObject;
 /** @brief Object representing a JSON document */
 typedef struct JYDocument_ JYDocument;
+/** @brief Memory region that documents are allocated from */
+typedef struct JYArena_ JYArena;
+/** @brief Table of keys that documents share a single copy of */
+typedef struct JYKeyTable_ JYKeyTable;
+
+/** @brief Set of functions the library uses to get memory */
+typedef struct JYAllocator_ {
+	/** @brief Allocates size bytes, returns NULL on failure */
+	void *(*alloc)(void *user, size_t size);
+	/** @brief Frees memory returned by alloc */
+	void (*free)(void *user, void *ptr);
+	/** @brief Passed as the first argument to alloc and free */
+	void *user;
+} JYAllocator;
+
+/**
+ * @brief Parse flag, keeps string values as views into the input which are
+ * only copied and decoded once they are accessed through jy_is_string
+ * @warning The input has to outlive the document, and the values are modified
+ * on first access, so such a document is not safe to read from multiple
+ * threads at once
+ */
+#define JY_PARSE_STRING_VIEWS (1u << 0)
+
+/**
+ * @brief Parse flag, uses the structural index engine, which first finds all
+ * structural characters of the input using SIMD instructions and then builds
+ * the tree from them. It is meant for large documents, while small ones are
+ * faster to parse with the default recursive descent engine
+ * @note Input with comments is always parsed with the default engine
+ */
+#define JY_PARSE_STRUCTURAL_INDEX (1u << 1)
+
+/**
+ * @brief Parse flag, gives wide objects a hash table of their keys, so that
+ * jy_index_s looks keys up in constant time instead of a binary search
+ */
+#define JY_PARSE_HASH_KEYS (1u << 2)
+
+/**
+ * @brief Parse flag, counts the elements of every array and object in a quick
+ * pass before parsing, so that they are parsed straight into memory of their
+ * exact size instead of being collected and copied over once they are closed
+ * @note The extra pass over the input pays off for documents with big arrays
+ * and objects. With the structural index engine, it walks the index instead of
+ * the input, which makes it a lot cheaper
+ */
+#define JY_PARSE_PRESCAN (1u << 3)
+
+/**
+ * @brief Parse flag, parses nested arrays and objects only once they are
+ * accessed through jy_is_array or jy_is_object, until then they are skipped
+ * over by matching brackets
+ * @warning The input has to outlive the document, and since values are
+ * modified on first access, such a document is not safe to read from multiple
+ * threads at once. Errors inside a nested array or object are only found once
+ * it is accessed, in which case jy_is_array or jy_is_object return zero
+ * @note Lazy documents are always parsed with the recursive descent engine,
+ * and without the pre-scan
+ */
+#define JY_PARSE_LAZY (1u << 4)
+
+/**
+ * @brief Parse flag, rejects strings that are not valid UTF-8, such as ones
+ * with overlong sequences, surrogates or code points past U+10FFFF. Runs of
+ * ASCII are still scanned a block at a time
+ */
+#define JY_PARSE_VALIDATE_UTF8 (1u << 5)
+
+/** @brief Error code, there was no error */
+#define JY_ERROR_NONE (0)
+
+/** @brief Error code, the input does not follow the grammar, or ends early */
+#define JY_ERROR_SYNTAX (1)
+
+/**
+ * @brief Error code, a string has a control character or an invalid escape
+ * sequence, a key has an escaped NUL character, or a string is not valid UTF-8
+ * when parsing with JY_PARSE_VALIDATE_UTF8
+ */
+#define JY_ERROR_STRING (2)
+
+/** @brief Error code, an object has the same key more than once */
+#define JY_ERROR_DUPLICATE_KEY (3)
+
+/** @brief Error code, arrays and objects are nested deeper than allowed */
+#define JY_ERROR_DEPTH (4)
+
+/**
+ * @brief Error code, a string is longer than 4294967295 bytes, or an array or
+ * object has more elements than that
+ */
+#define JY_ERROR_TOO_LARGE (5)
+
+/** @brief Error code, memory ran out */
+#define JY_ERROR_MEMORY (6)
+
+/**
+ * @brief Error code, jy_path_parse found no value at the path, or jy_extract
+ * found no value for a required field
+ */
+#define JY_ERROR_NOT_FOUND (7)
+
+/** @brief Error code, jy_parse_file could not open or read the file */
+#define JY_ERROR_IO (8)
+
+/** @brief Error code, jy_extract found a value of the wrong type for a field */
+#define JY_ERROR_TYPE (9)
+
+/** @brief What made parsing fail, and where in the input */
+typedef struct JYError_ {
+	/** @brief One of the JY_ERROR_* codes */
+	int code;
+	/** @brief Offset in bytes from the start of the input */
+	size_t offset;
+	/** @brief Line of the offset, starting at 1 */
+	size_t line;
+	/** @brief Column of the offset in bytes, starting at 1 */
+	size_t column;
+} JYError;
+
+/**
+ * @brief What parsing a document took, to size arenas and find out which inputs
+ * are slow. It is only filled in when the library is compiled with
+ * JAYCEON_STATS, otherwise it is left as it is
+ */
+typedef struct JYStats_ {
+	/** @brief Bytes of input the root value took up, trailing content aside */
+	size_t bytes;
+	/** @brief Number of nulls parsed */
+	size_t nulls;
+	/** @brief Number of booleans parsed */
+	size_t bools;
+	/** @brief Number of numbers parsed */
+	size_t numbers;
+	/** @brief Number of strings parsed, not counting keys */
+	size_t strings;
+	/** @brief Number of keys parsed */
+	size_t keys;
+	/**
+	 * @brief Number of arrays parsed, lazy ones included even though what is
+	 * in them is not parsed yet
+	 */
+	size_t arrays;
+	/** @brief Number of objects parsed, lazy ones included */
+	size_t objects;
+	/** @brief Deepest that arrays and objects were nested, counting the root */
+	size_t max_depth;
+	/** @brief Number of allocations made, for the arena and temporary memory */
+	size_t allocs;
+	/**
+	 * @brief How many of the allocations grew temporary memory, like the stack
+	 * that elements are collected on, by moving it into a bigger block
+	 */
+	size_t grows;
+	/** @brief Bytes the document takes up in its arena */
+	size_t arena_bytes;
+	/**
+	 * @brief Most bytes that were allocated at once. Temporary memory counts
+	 * until parsing is done, when most of it is freed
+	 */
+	size_t peak_bytes;
+	/**
+	 * @brief Seconds spent parsing numbers, only measured when the library is
+	 * compiled with JAYCEON_STATS_TIME
+	 */
+	double number_seconds;
+	/** @brief Seconds spent parsing strings and keys, like number_seconds */
+	double string_seconds;
+} JYStats;
 
 /**
- * @brief Parses a serialized JSON object
+ * @brief Gets a short description of an error code, like "duplicate key"
+ * @param code The JY_ERROR_* code to describe
+ * @return A static string, which is never NULL
+ */
+const char *jy_error_string(int code);
+
+/**
+ * @brief Options that control parsing, zero-initialize it for the defaults
+ */
+typedef struct JYParseOptions_ {
+	/** @brief Combination of JY_PARSE_* flags */
+	unsigned flags;
+	/**
+	 * @brief Arena to allocate the document from, if NULL the document gets
+	 * its own arena which is freed by jy_free
+	 */
+	JYArena *arena;
+	/**
+	 * @brief Allocator used for the document's own arena and temporary
+	 * memory, if NULL malloc and free are used
+	 */
+	const JYAllocator *allocator;
+	/**
+	 * @brief Table to take the keys of objects from, adding the ones it does
+	 * not have yet unless it is frozen, or NULL to copy them into the arena
+	 */
+	JYKeyTable *keys;
+	/**
+	 * @brief How deep arrays and objects can be nested, counting the root, or
+	 * 0 for JAYCEON_MAX_DEPTH (1024 unless the library is compiled otherwise).
+	 * Parsing takes no more of the call stack for deeper input either way
+	 */
+	size_t max_depth;
+	/**
+	 * @brief Filled in with what made parsing fail, or with JY_ERROR_NONE and
+	 * zeros on success, unless it is NULL
+	 * @note Errors are found where the input stops making sense, which is not
+	 * always where the mistake was made, like a missing quote. A duplicate key
+	 * is reported at the end of its object. After jy_parse_insitu, lines and
+	 * columns count the newlines of strings that were decoded in place
+	 */
+	JYError *error;
+	/**
+	 * @brief Filled in with what parsing took unless it is NULL, by jy_parse_ex,
+	 * jy_parse_n_ex, jy_parse_insitu, jy_parse_file and readers of records for
+	 * every record (but not jy_records_parallel). On failure, it holds what
+	 * was parsed before parsing failed
+	 */
+	JYStats *stats;
+} JYParseOptions;
+
+/**
+ * @brief Parses a serialized JSON value, which is usually an object or an array
+ * but can be of any type
  * @param string The string to be parsed
  * @return Resulting document, or NULL on failure
+ * @note The value has to start right at the beginning, and anything after it
+ * is ignored, once a number, true, false or null is followed by something that
+ * cannot be a part of it. Strings longer than 4294967295 bytes, and arrays and
+ * objects with more elements than that, are not supported and make parsing
+ * fail, and so does nesting deeper than JAYCEON_MAX_DEPTH
  */
 JYDocument *jy_parse(const char *string);
 
+/**
+ * @brief Parses a serialized JSON value using the given options
+ * @param string The string to be parsed
+ * @param opts The options to use, or NULL for the defaults
+ * @return Resulting document, or NULL on failure
+ */
+JYDocument *jy_parse_ex(const char *string, const JYParseOptions *opts);
+
+/**
+ * @brief Parses a serialized JSON value that is not NUL terminated
+ * @param buf The buffer to be parsed
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @return Resulting document, or NULL on failure
+ */
+JYDocument *jy_parse_n(const char *buf, size_t len);
+
+/**
+ * @brief Parses a serialized JSON value that is not NUL terminated, using the
+ * given options
+ * @param buf The buffer to be parsed
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param opts The options to use, or NULL for the defaults
+ * @return Resulting document, or NULL on failure
+ */
+JYDocument *jy_parse_n_ex(const char *buf, size_t len, const JYParseOptions *opts);
+
+/**
+ * @brief Parses a serialized JSON value in situ, decoding strings in place
+ * @param buf The buffer to be parsed, its contents are destroyed
+ * @param len The length of the buffer, nothing past buf + len is ever touched
+ * @param opts The options to use, or NULL for the defaults
+ * @return Resulting document, or NULL on failure
+ * @note Strings of the document point into the buffer, so it has to outlive
+ * the document. On failure the buffer is left in an unspecified state
+ */
+JYDocument *jy_parse_insitu(char *buf, size_t len, const JYParseOptions *opts);
+
+/**
+ * @brief Parses the serialized JSON value in a file, using the given options
+ * @param path The path of the file to be parsed
+ * @param opts The options to use, or NULL for the defaults
+ * @return Resulting document, or NULL on failure
+ * @note On POSIX systems, the file is mapped into memory instead of being read
+ * into a copy. With JY_PARSE_STRING_VIEWS or JY_PARSE_LAZY, values keep
+ * pointing into it, so it stays open until jy_free, and otherwise it is closed
+ * right after parsing
+ * @warning jy_free has to be called on the document even if it was parsed into
+ * an arena of the options, or the file is never closed
+ */
+JYDocument *jy_parse_file(const char *path, const JYParseOptions *opts);
+
+/**
+ * @brief Callbacks for jy_parse_sax, any of them can be NULL to ignore the
+ * event. Returning zero from a callback stops parsing
+ * @note Strings and keys are not NUL terminated, and are only valid during the
+ * call
+ */
+typedef struct JYHandler_ {
+	/** @brief Called for a null value */
+	int (*null_value)(void *user);
+	/** @brief Called for a boolean value */
+	int (*bool_value)(void *user, int val);
+	/** @brief Called for a number, and also for integers if integer is NULL */
+	int (*number)(void *user, double val);
+	/** @brief Called for a number that jy_is_int64 would accept */
+	int (*integer)(void *user, JYInt64 val);
+	/** @brief Called for a string value */
+	int (*string)(void *user, const char *str, size_t len);
+	/** @brief Called when an object starts */
+	int (*start_object)(void *user);
+	/** @brief Called for the key of every pair, before its value */
+	int (*key)(void *user, const char *key, size_t len);
+	/** @brief Called when an object ends */
+	int (*end_object)(void *user);
+	/** @brief Called when an array starts */
+	int (*start_array)(void *user);
+	/** @brief Called when an array ends */
+	int (*end_array)(void *user);
+	/** @brief Passed as the first argument to every callback */
+	void *user;
+} JYHandler;
+
+/**
+ * @brief Parses a serialized JSON value, reporting what it contains to the
+ * callbacks of the handler instead of building a document
+ * @param buf The buffer to be parsed
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param handler The callbacks to report to
+ * @param allocator Allocator for temporary memory, or NULL to use malloc and
+ * free
+ * @return Non-zero on success, zero on failure or if a callback stopped it
+ * @note Memory use only grows with the nesting depth and the length of strings
+ * with escape sequences, not with the size of the input. Events are reported
+ * as soon as they are parsed, so some may be reported before the input turns
+ * out to be invalid, and duplicate keys are not detected. Nesting deeper than
+ * JAYCEON_MAX_DEPTH makes parsing fail
+ */
+int jy_parse_sax(const char *buf, size_t len, const JYHandler *handler, const JYAllocator *allocator);
+
+/**
+ * @brief Checks that a buffer holds a serialized JSON value which jy_parse
+ * would accept, without building anything
+ * @param buf The buffer to be checked
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param opts The options to check with, or NULL for the defaults. Only the
+ * JY_PARSE_VALIDATE_UTF8 flag, the maximum depth, the allocator and the error
+ * are used
+ * @return Non-zero if the input is valid, zero if it is not or memory ran out
+ * @note Nothing is allocated unless arrays and objects are nested more than
+ * 4096 levels deep. Unlike jy_parse, duplicate keys, keys with a NUL
+ * character and strings, arrays and objects that are too large are not
+ * detected
+ */
+int jy_validate(const char *buf, size_t len, const JYParseOptions *opts);
+
+/** @brief Parser that is fed the input a chunk at a time */
+typedef struct JYParser_ JYParser;
+
+/**
+ * @brief Creates a parser that is fed the input in chunks, which can end
+ * anywhere, even in the middle of a token
+ * @param handler Callbacks to report to like jy_parse_sax does, or NULL to
+ * build a document instead
+ * @param opts The options to use, or NULL for the defaults
+ * @return The parser, or NULL if allocation failed
+ * @note Strings are always copied, so JY_PARSE_STRING_VIEWS has no effect, and
+ * neither do JY_PARSE_STRUCTURAL_INDEX and JY_PARSE_PRESCAN. The error of the
+ * options is filled in once feeding fails, with its offset from the start of
+ * the first chunk, so it has to outlive the parser
+ */
+JYParser *jy_parser_new(const JYHandler *handler, const JYParseOptions *opts);
+
+/**
+ * @brief Parses the next chunk of the input
+ * @param parser The parser to feed
+ * @param chunk The chunk to be parsed, it does not need to outlive the call
+ * @param len The length of the chunk
+ * @return Non-zero unless the input is invalid, memory ran out, or a callback
+ * stopped parsing
+ * @note Like jy_parse, anything after the root value is ignored. A number,
+ * true, false or null as the root is only complete once something that cannot
+ * be a part of it follows, like a newline
+ */
+int jy_parser_feed(JYParser *parser, const char *chunk, size_t len);
+
+/**
+ * @brief Checks if the root value of the input has been parsed
+ * @param parser The parser to check
+ * @return Non-zero if the root value is complete
+ */
+int jy_parser_done(JYParser *parser);
+
+/**
+ * @brief Takes the document away from the parser, once it is done
+ * @param parser The parser to take the document from
+ * @return The document, which has to be freed with jy_free, or NULL if the
+ * parser is not done, reports to a handler, or the document was already taken
+ */
+JYDocument *jy_parser_document(JYParser *parser);
+
+/**
+ * @brief Frees the parser, and its document unless it was taken
+ * @param parser The parser to free
+ * @note The memory of a document that was not finished in a user supplied
+ * arena is only freed once the arena is reset or freed
+ */
+void jy_parser_free(JYParser *parser);
+
+/** @brief Reader of newline delimited JSON (NDJSON, JSON Lines) records */
+typedef struct JYRecords_ JYRecords;
+
+/**
+ * @brief Creates a reader of the records of a buffer, one JSON value per line
+ * @param buf The buffer to read, for example a mapped file, which has to
+ * outlive the reader
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param opts The options to parse every record with, or NULL for the defaults
+ * @return The reader, or NULL if allocation failed
+ * @note Every record is parsed into the same arena, which is reset first. That
+ * is the arena of the options, if there is one, otherwise the reader has its own.
+ * The error of the options is filled in for every record, with its offset and
+ * line counted from the start of the buffer
+ */
+JYRecords *jy_records_new(const char *buf, size_t len, const JYParseOptions *opts);
+
+/**
+ * @brief Parses the next record, skipping blank lines and whitespace before it
+ * @param records The reader to read from
+ * @param out The document of the record, or NULL if it is invalid. It is only
+ * valid until the next call, and is not to be passed to jy_free
+ * @return Non-zero if there was another record, zero at the end of the buffer
+ */
+int jy_records_next(JYRecords *records, JYDocument **out);
+
+/**
+ * @brief Gets the line number of the last record read, for error messages
+ * @param records The reader to query
+ * @return The line number, starting at 1
+ */
+size_t jy_records_line(JYRecords *records);
+
+/**
+ * @brief Frees the reader, along with the last document it read
+ * @param records The reader to free
+ */
+void jy_records_free(JYRecords *records);
+
+/**
+ * @brief Called for every record by jy_records_parallel
+ * @param user The user pointer passed to jy_records_parallel
+ * @param line The line number of the record, starting at 1
+ * @param doc The document of the record, or NULL if it is invalid. It is only
+ * valid during the call, and is not to be passed to jy_free
+ * @return Zero to stop reading
+ */
+typedef int (*JYRecordCallback)(void *user, size_t line, JYDocument *doc);
+
+/** @brief Options of jy_records_parallel, zero-initialize it for the defaults */
+typedef struct JYParallelOptions_ {
+	/** @brief Number of worker threads, 0 for one */
+	unsigned threads;
+	/** @brief Number of bytes every worker parses at a time, 0 for the default */
+	size_t chunk_size;
+	/**
+	 * @brief One allocator for every worker, so that they need no locking, or
+	 * NULL to use the allocator of the parse options for all of them
+	 */
+	const JYAllocator *allocators;
+} JYParallelOptions;
+
+/**
+ * @brief Parses the records of a buffer like jy_records_next, splitting it
+ * between worker threads, and reports them in order
+ * @param buf The buffer to read
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param opts The options to parse every record with, or NULL for the defaults
+ * @param popts The options of the workers, or NULL for the defaults
+ * @param callback Called for every record in order, on the calling thread
+ * @param user Passed as the first argument to the callback
+ * @return Non-zero unless memory ran out, the callback stopped reading, or the
+ * key table of the parse options is not frozen
+ * @note Every worker parses into an arena of its own, so the arena of the parse
+ * options is not used, and neither is the error. Workers are threads only if
+ * the library is compiled with JAYCEON_PTHREADS, otherwise the calling thread
+ * does all of the work
+ */
+int jy_records_parallel(const char *buf, size_t len, const JYParseOptions *opts, const JYParallelOptions *popts, JYRecordCallback callback, void *user);
+
 /**
  * @brief Frees all memory allocated to the document
  * @param doc the document to free
+ * @note Documents parsed into a user supplied arena are only freed once the
+ * arena is reset or freed, this function only closes the file of jy_parse_file
+ * for them
  */
 void jy_free(JYDocument *doc);
 
 /**
- * @brief Returns the root of the JSON document
+ * @brief Creates an arena that documents can be parsed into
+ * @param buffer Memory to hold the arena and its first block, or NULL to
+ * allocate it using the allocator
+ * @param size Size of the buffer, or of the first block to allocate (0 for
+ * the default)
+ * @param allocator Allocator used for the blocks that do not fit into the
+ * first one, or NULL to use malloc and free
+ * @return The arena, or NULL if allocation failed or the buffer is too small
+ */
+JYArena *jy_arena_new(void *buffer, size_t size, const JYAllocator *allocator);
+
+/**
+ * @brief Frees all documents in the arena, keeping its memory for reuse
+ * @param arena The arena to reset
+ */
+void jy_arena_reset(JYArena *arena);
+
+/**
+ * @brief Frees the arena and all documents in it
+ * @param arena The arena to free
+ */
+void jy_arena_free(JYArena *arena);
+
+/**
+ * @brief Creates an empty key table. Documents parsed with it keep a single
+ * copy of every key, in the table, so that equal keys are equal pointers which
+ * take no memory from the document's arena
+ * @param allocator Allocator used for the table and its keys, or NULL to use
+ * malloc and free
+ * @return The table, or NULL if allocation failed
+ * @warning The table has to outlive every document parsed with it. Only one
+ * thread at a time can parse with a table that is not frozen
+ */
+JYKeyTable *jy_keys_new(const JYAllocator *allocator);
+
+/**
+ * @brief Gets the table's copy of the key, adding it unless the table is
+ * frozen. Lookups with it compare keys by their pointers first
+ * @param table The table to look into
+ * @param key The key to intern
+ * @return The table's copy of the key, or NULL if the table is frozen and
+ * does not have it, or allocation failed
+ */
+const char *jy_keys_intern(JYKeyTable *table, const char *key);
+
+/**
+ * @brief Stops keys from being added to the table, so that any number of
+ * threads can parse with it at once. Keys it does not have are then copied
+ * into the arenas of the documents instead
+ * @param table The table to freeze
+ */
+void jy_keys_freeze(JYKeyTable *table);
+
+/**
+ * @brief Frees the table and all of its keys
+ * @param table The table to free
+ */
+void jy_keys_free(JYKeyTable *table);
+
+/**
+ * @brief Returns the root of the JSON document, if it is an object
  * @param doc The document to query
- * @return The root object of the document
- * @note This function cannot fail
+ * @return The root object of the document, or NULL if the root is of another
+ * type, in which case it is accessed through jy_root_value
  */
 JYObject *jy_root(JYDocument *doc);
 
+/**
+ * @brief Returns the root value of the JSON document, of any type
+ * @param doc The document to query
+ * @return The root value of the document, which can also be changed with the
+ * construction functions like any other value
+ * @note This function cannot fail
+ */
+JYValue *jy_root_value(JYDocument *doc);
+
+/**
+ * @brief Creates a document with an empty root object, to be filled with the
+ * construction functions
+ * @param opts The options holding the arena and allocator to use, or NULL for
+ * the defaults. The flags are not used
+ * @return The document, which has to be freed with jy_free, or NULL if
+ * allocation failed
+ * @note The root can be set to a value of another type through jy_root_value.
+ * Any document can be changed with the construction functions, which
+ * allocate everything they need from its arena. The memory of values that are
+ * replaced is only given back once the document is freed
+ */
+JYDocument *jy_new(const JYParseOptions *opts);
+
+/**
+ * @brief Adds a null value at the end of the array
+ * @param doc The document of the array
+ * @param arr The array to add to
+ * @return The added value, or NULL if allocation failed
+ * @warning The values of the array, and arrays and objects held by them which
+ * were not made with jy_set_array or jy_set_object, can move when it grows.
+ * Pointers to them are only valid until the array is changed again
+ */
+JYValue *jy_array_append(JYDocument *doc, JYArray *arr);
+
+/**
+ * @brief Inserts a null value into the array, moving the values past it
+ * @param doc The document of the array
+ * @param arr The array to insert into
+ * @param index The index of the new value, up to the length of the array
+ * @return The inserted value, or NULL if allocation failed or the index is out
+ * of bounds
+ * @warning Like for jy_array_append, pointers to the values of the array are
+ * only valid until it is changed again
+ */
+JYValue *jy_array_insert(JYDocument *doc, JYArray *arr, size_t index);
+
+/**
+ * @brief Finds the value of the key in the object, or adds the key with a null
+ * value if it is not there yet
+ * @param doc The document of the object
+ * @param obj The object to set the key of
+ * @param key The key to set, which is copied
+ * @return The value of the key, or NULL if allocation failed
+ * @note Added keys are sorted in all at once when the object is next looked
+ * into, so adding many of them costs no more than parsing them would
+ * @warning Like for jy_array_append, pointers to the values of the object are
+ * only valid until it is changed or looked into again. Objects with a hash
+ * table of their keys lose it once they are changed
+ */
+JYValue *jy_object_set(JYDocument *doc, JYObject *obj, const char *key);
+
+/**
+ * @brief Sets the value to null
+ * @param val The value to set
+ */
+void jy_set_null(JYValue *val);
+
+/**
+ * @brief Sets the value to a boolean
+ * @param val The value to set
+ * @param b The boolean, zero for false and anything else for true
+ */
+void jy_set_bool(JYValue *val, int b);
+
+/**
+ * @brief Sets the value to a number
+ * @param val The value to set
+ * @param num The number
+ */
+void jy_set_number(JYValue *val, double num);
+
+/**
+ * @brief Sets the value to an integer, which is kept exactly
+ * @param val The value to set
+ * @param num The integer
+ */
+void jy_set_int64(JYValue *val, JYInt64 num);
+
+/**
+ * @brief Sets the value to a copy of a NUL terminated string
+ * @param doc The document of the value
+ * @param val The value to set
+ * @param str The string
+ * @return Non-zero on success, zero if allocation failed
+ */
+int jy_set_string(JYDocument *doc, JYValue *val, const char *str);
+
+/**
+ * @brief Sets the value to a copy of a string of the given length
+ * @param doc The document of the value
+ * @param val The value to set
+ * @param str The string, which can contain NUL characters
+ * @param len The length of the string in bytes
+ * @return Non-zero on success, zero if allocation failed
+ */
+int jy_set_string_n(JYDocument *doc, JYValue *val, const char *str, size_t len);
+
+/**
+ * @brief Sets the value to an empty array
+ * @param doc The document of the value
+ * @param val The value to set
+ * @return The array, or NULL if allocation failed
+ * @note The array stays where it is when the container holding the value grows,
+ * so the pointer stays valid for as long as the document does
+ */
+JYArray *jy_set_array(JYDocument *doc, JYValue *val);
+
+/**
+ * @brief Sets the value to an empty object
+ * @param doc The document of the value
+ * @param val The value to set
+ * @return The object, or NULL if allocation failed
+ * @note Like for jy_set_array, the pointer stays valid for as long as the
+ * document does
+ */
+JYObject *jy_set_object(JYDocument *doc, JYValue *val);
+
+/** @brief Compiled JSON Pointer (RFC 6901), like "/items/3/name" */
+typedef struct JYPath_ JYPath;
+
+/**
+ * @brief Compiles a JSON Pointer, which is a slash before every step, a key of
+ * an object or an index of an array. In keys, ~1 stands for a slash and ~0 for
+ * a tilde
+ * @param pointer The pointer to compile, "" for the root value
+ * @param allocator Allocator to allocate the path with, or NULL to use malloc
+ * @return The path, or NULL if the pointer is invalid or allocation failed
+ * @note The hashes of the keys are computed once here, for looking them up in
+ * objects with a hash table
+ */
+JYPath *jy_path_compile(const char *pointer, const JYAllocator *allocator);
+
+/**
+ * @brief Finds the value at the path in the document
+ * @param path The path to follow
+ * @param doc The document to look into
+ * @return The value, or NULL if there is none
+ * @note In lazy documents, only the arrays and objects along the path are
+ * parsed
+ */
+JYValue *jy_path_get(const JYPath *path, JYDocument *doc);
+
+/**
+ * @brief Parses only the value at the path out of a serialized JSON value,
+ * skipping over everything before it without building it
+ * @param path The path to follow
+ * @param buf The buffer to be parsed
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param opts The options to parse the value with, or NULL for the defaults
+ * @param out The value, it belongs to the returned document
+ * @return A document with an empty root object that holds the value, or NULL
+ * if there is no value at the path (JY_ERROR_NOT_FOUND), or parsing failed
+ * @warning What is skipped is only checked as much as it takes to find its
+ * end, like the subtrees of lazy documents, and nothing past the value is
+ * looked at, so invalid input can go unnoticed. Of pairs with the same key,
+ * the first one is followed
+ */
+JYDocument *jy_path_parse(const JYPath *path, const char *buf, size_t len, const JYParseOptions *opts, JYValue **out);
+
+/**
+ * @brief Frees the path
+ * @param path The path to free
+ */
+void jy_path_free(JYPath *path);
+
+/** @brief Field type, an int set to 1 for true and 0 for false */
+#define JY_FIELD_BOOL (1)
+
+/** @brief Field type, a double */
+#define JY_FIELD_NUMBER (2)
+
+/** @brief Field type, a JYInt64, which only takes numbers with integer values */
+#define JY_FIELD_INT64 (3)
+
+/** @brief Field type, a const char * to a NUL terminated string */
+#define JY_FIELD_STRING (4)
+
+/** @brief Describes a member of a struct that jy_extract fills in */
+typedef struct JYField_ {
+	/** @brief The key of the field */
+	const char *name;
+	/** @brief One of the JY_FIELD_* types, which the member has to be of */
+	int type;
+	/** @brief Offset of the member in the struct, as given by offsetof */
+	size_t offset;
+	/** @brief Non-zero if extracting fails when the field is missing */
+	int required;
+} JYField;
+
+/**
+ * @brief Parses a serialized JSON object straight into a struct, by a table of
+ * the fields to fill in
+ * @param buf The buffer to be parsed
+ * @param len The length of the buffer, nothing past buf + len is ever read
+ * @param fields The fields of the struct
+ * @param count The number of fields
+ * @param out The struct to fill in
+ * @param opts The options to use, or NULL for the defaults
+ * @return Non-zero on success, zero on failure
+ * @note Members of fields that are missing or null are left as they are. Keys
+ * that are not fields are skipped like in jy_path_parse, without building
+ * values for them. A field's key that comes more than once makes it fail with
+ * JY_ERROR_DUPLICATE_KEY, like jy_parse, but duplicates of other keys are not
+ * detected. String fields are copied into the arena of the options, so they
+ * fail without one
+ * @warning On failure, some members may already have been written to
+ */
+int jy_extract(const char *buf, size_t len, const JYField *fields, size_t count, void *out, const JYParseOptions *opts);
+
+/**
+ * @brief Same as jy_extract, but decodes strings in situ instead of copying
+ * them, so string fields need no arena
+ * @param buf The buffer to be parsed, its contents are destroyed
+ * @param len The length of the buffer, nothing past buf + len is ever touched
+ * @param fields The fields of the struct
+ * @param count The number of fields
+ * @param out The struct to fill in
+ * @param opts The options to use, or NULL for the defaults
+ * @return Non-zero on success, zero on failure
+ * @note String fields point into the buffer, so it has to outlive them
+ */
+int jy_extract_insitu(char *buf, size_t len, const JYField *fields, size_t count, void *out, const JYParseOptions *opts);
+
+/**
+ * @brief Function that the output of jy_write is passed to, one chunk at a time
+ * @return Non-zero to go on, zero to stop writing
+ */
+typedef int (*JYWriteCallback)(void *user, const char *data, size_t len);
+
+/**
+ * @brief Write flag, puts every element of an array or object on a line of its
+ * own, indented by a tab per level, instead of writing everything on one line
+ */
+#define JY_WRITE_PRETTY (1u << 0)
+
+/**
+ * @brief Serializes the document
+ * @param doc The document to serialize
+ * @param flags Combination of JY_WRITE_* flags
+ * @param callback The function to pass the output to
+ * @param user Passed as the first argument to the callback
+ * @return Non-zero on success, zero if the callback stopped it, or a string
+ * view or lazy subtree of the document could not be parsed
+ * @note Numbers are written with the fewest digits that read back as the same
+ * double, infinities and NaN are written as null
+ */
+int jy_write(JYDocument *doc, unsigned flags, JYWriteCallback callback, void *user);
+
+/**
+ * @brief Serializes the document into a NUL terminated buffer
+ * @param doc The document to serialize
+ * @param flags Combination of JY_WRITE_* flags
+ * @param out_len The length of the output without the terminator, or NULL
+ * @param allocator Allocator to allocate the buffer with, or NULL to use malloc
+ * @return The buffer, to be freed with the allocator, or NULL on failure
+ */
+char *jy_write_string(JYDocument *doc, unsigned flags, size_t *out_len, const JYAllocator *allocator);
+
 /**
  * @brief Serializes the document and prints it out into stdout
  * @param doc The document to print
@@ -70,6 +889,47 @@ JYObject *jy_root(JYDocument *doc);
  */
 void jy_print(JYDocument *doc);
 
+/**
+ * @brief Writes the document out as a snapshot, a binary copy of its values
+ * that can be loaded with jy_snapshot_load without parsing it again
+ * @param doc The document to write
+ * @param out_size The size of the snapshot in bytes, or NULL
+ * @param allocator Allocator to allocate the snapshot with, or NULL to use malloc
+ * @return The snapshot, to be freed with the allocator, or NULL on failure
+ * @note Snapshots refer to their contents by offsets instead of pointers, with
+ * the keys of objects sorted like in documents and every distinct key kept only
+ * once. They can only be loaded by builds of the library for the same kind of
+ * machine
+ */
+void *jy_snapshot_write(JYDocument *doc, size_t *out_size, const JYAllocator *allocator);
+
+/**
+ * @brief Makes a document of a snapshot, which is used right where it is
+ * @param buf The snapshot, aligned like memory from malloc
+ * @param len The size of the buffer, nothing past buf + len is ever read
+ * @param opts The options to use, or NULL for the defaults, only the allocator,
+ * arena and error are used
+ * @return Resulting document, or NULL on failure
+ * @note Only the header of the snapshot is checked, the rest of it is trusted
+ * to be a snapshot written by jy_snapshot_write. The snapshot is never written
+ * to, so it can be shared between processes
+ * @warning The snapshot has to outlive the document, and the values of the
+ * document cannot be changed. Adding to its arrays and objects fails, and
+ * setting its values (other than the root) is undefined
+ */
+JYDocument *jy_snapshot_load(const void *buf, size_t len, const JYParseOptions *opts);
+
+/**
+ * @brief Makes a document of the snapshot in a file, which is mapped into
+ * memory on POSIX systems like with jy_parse_file
+ * @param path The path of the snapshot file
+ * @param opts The options to use, or NULL for the defaults
+ * @return Resulting document, or NULL on failure
+ * @note The file stays open until jy_free, which has to be called on the
+ * document even if it is in an arena of the options
+ */
+JYDocument *jy_snapshot_load_file(const char *path, const JYParseOptions *opts);
+
 /**
  * @brief Indexes an object by a string key
  * @param obj The object to index
@@ -95,6 +955,67 @@ JYValue *jy_index_i(JYArray *obj, size_t key);
  */
 JYValue *jy_index_i_obj(JYObject *obj, size_t index, const char **out_key);
 
+/**
+ * @brief Gets the number of values in an array
+ * @param arr The array to measure
+ * @return The number of values
+ */
+size_t jy_array_len(JYArray *arr);
+
+/**
+ * @brief Gets the number of pairs in an object
+ * @param obj The object to measure
+ * @return The number of pairs, or zero if the pairs that were set since the
+ * last lookup could not be merged into the others
+ */
+size_t jy_object_len(JYObject *obj);
+
+/**
+ * @brief Position in an array or object, which walks its values in order
+ * @note The fields are private, and the iterator is invalidated by anything
+ * that adds values to the array or object
+ */
+typedef struct JYIterator_ {
+	/** @brief The next value or pair */
+	void *next;
+	/** @brief Past the last value or pair */
+	void *end;
+	/** @brief Whether the pairs are those of a snapshot */
+	int snapshot;
+} JYIterator;
+
+/**
+ * @brief Starts iterating over the values of an array
+ * @param arr The array to iterate over
+ * @param out The iterator to start
+ */
+void jy_array_iter(JYArray *arr, JYIterator *out);
+
+/**
+ * @brief Gets the next value of an array iterator
+ * @param it The iterator to advance
+ * @return The next value, or NULL past the last one
+ */
+JYValue *jy_array_next(JYIterator *it);
+
+/**
+ * @brief Starts iterating over the pairs of an object, in the order of their
+ * keys
+ * @param obj The object to iterate over
+ * @param out The iterator to start
+ * @return Non-zero on success, zero if the pairs that were set since the last
+ * lookup could not be merged into the others
+ */
+int jy_object_iter(JYObject *obj, JYIterator *out);
+
+/**
+ * @brief Gets the next pair of an object iterator
+ * @param it The iterator to advance
+ * @param out_key The string key of the value (not written past the last pair)
+ * @return The next value, or NULL past the last pair
+ */
+JYValue *jy_object_next(JYIterator *it, const char **out_key);
+
 /**
  * @brief Checks if the value type is a null
  * @param val The value to check
@@ -118,19 +1039,46 @@ int jy_is_bool(JYValue *val, int *out);
  */
 int jy_is_number(JYValue *val, double *out);
 
+/**
+ * @brief Checks if the value type is a number with an integer value that fits
+ * into a JYInt64
+ * @param val The value to check
+ * @param out The integer value of the value object
+ * @return Non-zero if the value is such a number
+ * @note Integers written without a fraction or exponent are kept as they are,
+ * so unlike the double of jy_is_number, they are exact past 2^53
+ */
+int jy_is_int64(JYValue *val, JYInt64 *out);
+
 /**
  * @brief Checks if the value type is a string
  * @param val The value to check
  * @param out The string value of the value object
  * @return Non-zero if the value type is a string
+ * @note String views are copied into the document when first accessed, zero
+ * is returned if that fails
  */
 int jy_is_string(JYValue *val, const char **out);
 
+/**
+ * @brief Checks if the value type is a string, and gets its length
+ * @param val The value to check
+ * @param out The string value of the value object
+ * @param out_len The length of the string value in bytes
+ * @return Non-zero if the value type is a string
+ * @note The string value is not NUL terminated if it is a view into the input
+ * without escape sequences, such a view is returned without copying it. It can
+ * contain NUL characters, escaped as \u0000
+ */
+int jy_is_string_n(JYValue *val, const char **out, size_t *out_len);
+
 /**
  * @brief Checks if the value type is an array
  * @param val The value to check
  * @param out The array value of the value object
  * @return Non-zero if the value type is an array
+ * @note Arrays of lazy documents are parsed when first accessed, zero is
+ * returned if that fails
  */
 int jy_is_array(JYValue *val, JYArray **out);
 
@@ -139,6 +1087,8 @@ int jy_is_array(JYValue *val, JYArray **out);
  * @param val The value to check
  * @param out The object value of the value object
  * @return Non-zero if the value type is an object
+ * @note Objects of lazy documents are parsed when first accessed, zero is
+ * returned if that fails
  */
 int jy_is_object(JYValue *val, JYObject **out);
 
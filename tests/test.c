@@ -0,0 +1,403 @@
+/*
+ * Tests of JayceON, see the README for how to build and run them
+ *
+ * Documents built with the construction functions are checked by what they are
+ * written out as. Every input, from a list of tricky ones and from a generator
+ * of random ones, is parsed with every engine and set of parse flags, which all
+ * have to agree on whether it is valid, and on what it is written out as.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jayceon.h"
+
+#define CHECK(c) check((c), #c, __LINE__)
+
+/* Number of random inputs that the engines are compared on */
+#define RANDOM_INPUTS (2000)
+
+/* Ways of parsing that have to agree with each other */
+typedef struct Engine_ {
+	const char *name;
+	unsigned flags;
+} Engine;
+
+static const Engine engines[] = {
+	{ "structural_index", JY_PARSE_STRUCTURAL_INDEX },
+	{ "prescan", JY_PARSE_PRESCAN },
+	{ "structural_index+prescan", JY_PARSE_STRUCTURAL_INDEX | JY_PARSE_PRESCAN },
+	{ "string_views", JY_PARSE_STRING_VIEWS },
+	{ "hash_keys", JY_PARSE_HASH_KEYS },
+	{ "lazy", JY_PARSE_LAZY }
+};
+
+static const char *const inputs[] = {
+	"{}",
+	"[]",
+	"{\"a\":1.5,\"b\":[1,2,\"x\\n\"],\"c\":{\"d\":true,\"e\":null}}",
+	"[1,2,]",
+	"{\"a\":1,}",
+	"[1 2]",
+	"{\"a\":1,\"a\":2}",
+	"{\"a\":1",
+	"[\"\\u00e9\\ud83d\\ude00\",\"\\u0000\"]",
+	"[\"\\ud800\"]",
+	"[\"\\x\"]",
+	"[\"tab\tin string\"]",
+	"[\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaa\\\"\",1]",
+	"[\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\\\\\",1]",
+	"{\"a\\u0000b\":1}",
+	"{\"a\\u0000b\":1,\"a\":2}",
+	"[-0,0.5e10,-1E-3,9007199254740993,18446744073709551616]",
+	"[01]",
+	"[1.]",
+	"[.5]",
+	"[tru]",
+	"[true,false,null]",
+	"[1,/* comment */2]",
+	"[1,// comment\n2]",
+	" [1]",
+	"123",
+	"\"root\"",
+	"[[[[[[[[[[]]]]]]]]]]",
+	"{\"z\":1,\"y\":2,\"x\":3,\"w\":4,\"v\":5,\"u\":6,\"t\":7,\"s\":8,\"r\":9,\"q\":10,\"p\":11,\"o\":12,\"n\":13,\"m\":14,\"l\":15,\"k\":16,\"j\":17}"
+};
+
+static int failures;
+static unsigned long seed = 1;
+
+static void check(int ok, const char *what, int line) {
+	if (!ok) {
+		printf("%s:%d: check failed: %s\n", __FILE__, line, what);
+		++failures;
+	}
+}
+
+static unsigned long next_random(void) {
+	seed = seed * 1103515245ul + 12345ul;
+	return (seed >> 16) & 0x7FFFu;
+}
+
+/* Writes the document compactly, the result has to be freed */
+static char *write_compact(JYDocument *doc, size_t *len) {
+	return jy_write_string(doc, 0, len, NULL);
+}
+
+static int written_as(JYDocument *doc, const char *expected) {
+	char *out;
+	size_t len;
+	int same;
+
+	if (!(out = write_compact(doc, &len)))
+		return 0;
+
+	same = len == strlen(expected) && !memcmp(out, expected, len);
+	if (!same)
+		printf("written as %s instead of %s\n", out, expected);
+
+	free(out);
+	return same;
+}
+
+static void test_build(void) {
+	JYDocument *doc;
+	JYObject *root, *inner;
+	JYArray *arr;
+	JYValue *val;
+	char key[16];
+	size_t i;
+
+	CHECK((doc = jy_new(NULL)) != NULL);
+	if (!doc)
+		return;
+
+	root = jy_root(doc);
+	CHECK(written_as(doc, "{}"));
+
+	jy_set_number(jy_object_set(doc, root, "b"), 1.5);
+	jy_set_int64(jy_object_set(doc, root, "a"), -42);
+	jy_set_bool(jy_object_set(doc, root, "c"), 1);
+	CHECK(jy_set_string(doc, jy_object_set(doc, root, "d"), "x\"y"));
+	CHECK(jy_set_string_n(doc, jy_object_set(doc, root, "e"), "n\0l", 3));
+	CHECK(written_as(doc, "{\"a\":-42,\"b\":1.5,\"c\":true,\"d\":\"x\\\"y\",\"e\":\"n\\u0000l\"}"));
+
+	/* Setting a key again changes the value it already has */
+	jy_set_number(jy_object_set(doc, root, "a"), 7);
+	CHECK(jy_object_len(root) == 5);
+	CHECK(written_as(doc, "{\"a\":7,\"b\":1.5,\"c\":true,\"d\":\"x\\\"y\",\"e\":\"n\\u0000l\"}"));
+
+	CHECK((arr = jy_set_array(doc, jy_object_set(doc, root, "f"))) != NULL);
+	CHECK((inner = jy_set_object(doc, jy_object_set(doc, root, "g"))) != NULL);
+
+	if (arr && inner) {
+		jy_set_number(jy_array_append(doc, arr), 2);
+		jy_set_number(jy_array_append(doc, arr), 3);
+		jy_set_number(jy_array_insert(doc, arr, 0), 1);
+		CHECK(jy_array_insert(doc, arr, 4) == NULL);
+		jy_set_null(jy_object_set(doc, inner, "h"));
+		CHECK(jy_array_len(arr) == 3);
+		CHECK((val = jy_index_i(arr, 2)) != NULL && jy_index_i(arr, 3) == NULL);
+	}
+
+	CHECK(written_as(doc, "{\"a\":7,\"b\":1.5,\"c\":true,\"d\":\"x\\\"y\",\"e\":\"n\\u0000l\",\"f\":[1,2,3],\"g\":{\"h\":null}}"));
+	jy_free(doc);
+
+	/* A key set twice before the object is looked into is still the same pair */
+	CHECK((doc = jy_new(NULL)) != NULL);
+	if (!doc)
+		return;
+
+	root = jy_root(doc);
+	val = jy_object_set(doc, root, "a");
+	jy_set_number(val, 1);
+	CHECK(jy_object_set(doc, root, "a") == val);
+	CHECK(written_as(doc, "{\"a\":1}"));
+
+	for (i = 0; i < 100; ++i) {
+		sprintf(key, "k%lu", (unsigned long) (i * 37 % 100));
+		jy_set_number(jy_object_set(doc, root, key), (double) i);
+	}
+
+	for (i = 0; i < 100; ++i) {
+		sprintf(key, "k%lu", (unsigned long) i);
+		jy_object_set(doc, root, key);
+	}
+
+	CHECK(jy_object_len(root) == 101);
+	jy_free(doc);
+
+	/* Keys are written out whole, escaped like strings */
+	CHECK((doc = jy_parse("{\"\\u00e9\\n\\\"\":1,\"k\\t\":2}")) != NULL);
+	if (!doc)
+		return;
+
+	CHECK(written_as(doc, "{\"k\\t\":2,\"\xc3\xa9\\n\\\"\":1}"));
+	jy_free(doc);
+}
+
+/* Generates a random value, with duplicate keys, escapes and mistakes now and then */
+static void random_value(char *buf, size_t *len, size_t cap, int depth) {
+	static const char *const scalars[] = {
+		"0", "-1", "1.25e3", "123456789012345678901", "true", "false", "null",
+		"\"\"", "\"abc\"", "\"\\u00e9\"", "\"\\n\\t\\\\\"", "\"\\ud83d\\ude00\"", "\"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\\\"\""
+	};
+	static const char *const keys[] = { "\"a\"", "\"b\"", "\"c\"", "\"\\u0061\"", "\"key with spaces\"" };
+	size_t count, i;
+	int object;
+
+	if (cap - *len < 64)
+		return;
+
+	if (depth > 4 || next_random() % 3 == 0) {
+		const char *s;
+
+		s = next_random() % 200 == 0 ? "tru" : scalars[next_random() % (sizeof(scalars) / sizeof(scalars[0]))];
+		memcpy(buf + *len, s, strlen(s));
+		*len += strlen(s);
+		return;
+	}
+
+	object = next_random() % 2;
+	buf[(*len)++] = object ? '{' : '[';
+	count = next_random() % 5;
+
+	for (i = 0; i < count && cap - *len >= 64; ++i) {
+		if (i)
+			buf[(*len)++] = next_random() % 300 ? ',' : ' ';
+
+		if (next_random() % 8 == 0)
+			buf[(*len)++] = ' ';
+
+		if (object) {
+			const char *key;
+
+			key = keys[next_random() % (sizeof(keys) / sizeof(keys[0]))];
+			memcpy(buf + *len, key, strlen(key));
+			*len += strlen(key);
+			buf[(*len)++] = ':';
+		}
+
+		random_value(buf, len, cap, depth + 1);
+	}
+
+	buf[(*len)++] = object ? '}' : ']';
+}
+
+/* Feeds the input to a push parser in random chunks */
+static JYDocument *parse_pushed(const char *buf, size_t len) {
+	JYParser *parser;
+	JYDocument *doc;
+	size_t pos, chunk;
+	int ok;
+
+	if (!(parser = jy_parser_new(NULL, NULL)))
+		return NULL;
+
+	ok = 1;
+
+	for (pos = 0; ok && pos < len; pos += chunk) {
+		chunk = 1 + next_random() % 7;
+		if (chunk > len - pos)
+			chunk = len - pos;
+
+		ok = jy_parser_feed(parser, buf + pos, chunk);
+	}
+
+	/* A scalar root is only complete once something follows it */
+	if (ok)
+		ok = jy_parser_feed(parser, "\n", 1);
+
+	doc = ok ? jy_parser_document(parser) : NULL;
+	jy_parser_free(parser);
+	return doc;
+}
+
+static int has_nul_escape(const char *buf, size_t len) {
+	size_t i;
+
+	for (i = 0; i + 6 <= len; ++i) {
+		if (!memcmp(buf + i, "\\u0000", 6))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Parses the input with every engine, and checks that they agree with the default one */
+static void compare_engines(const char *buf, size_t len) {
+	JYParseOptions opts;
+	JYDocument *expected, *doc;
+	JYError error;
+	char *out, *copy;
+	size_t out_len, i;
+	int code;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.error = &error;
+
+	expected = jy_parse_n_ex(buf, len, &opts);
+	code = error.code;
+	out = expected ? write_compact(expected, &out_len) : NULL;
+
+	CHECK(!expected || out);
+
+	for (i = 0; i <= sizeof(engines) / sizeof(engines[0]); ++i) {
+		const char *name;
+
+		if (i < sizeof(engines) / sizeof(engines[0])) {
+			name = engines[i].name;
+			opts.flags = engines[i].flags;
+			doc = jy_parse_n_ex(buf, len, &opts);
+		} else {
+			name = "insitu";
+			opts.flags = 0;
+
+			if (!(copy = malloc(len + 1)))
+				continue;
+
+			memcpy(copy, buf, len);
+			doc = jy_parse_insitu(copy, len, &opts);
+		}
+
+		/*
+		 * Lazy documents only find errors in nested containers once they are
+		 * written, and may find another error first
+		 */
+		if (doc && !expected && opts.flags == JY_PARSE_LAZY) {
+			if ((out = write_compact(doc, &out_len))) {
+				printf("%s: written instead of failing on %.*s\n", name, (int) len, buf);
+				++failures;
+				free(out);
+				out = NULL;
+			}
+		} else if (!doc != !expected || (!doc && error.code != code && opts.flags != JY_PARSE_LAZY)) {
+			printf("%s: %s gives error %d instead of %d on %.*s\n", name, doc ? "success" : "failure", doc ? 0 : error.code, expected ? 0 : code, (int) len, buf);
+			++failures;
+		} else if (doc && out && !written_as(doc, out)) {
+			printf("%s: written differently on %.*s\n", name, (int) len, buf);
+			++failures;
+		}
+
+		if (doc)
+			jy_free(doc);
+
+		if (i == sizeof(engines) / sizeof(engines[0]))
+			free(copy);
+	}
+
+	doc = parse_pushed(buf, len);
+	if (!doc != !expected || (doc && out && !written_as(doc, out))) {
+		printf("push parser disagrees on %.*s\n", (int) len, buf);
+		++failures;
+	}
+
+	if (doc)
+		jy_free(doc);
+
+	/* Unlike parsing, validation does not look for duplicate keys or NUL in keys */
+	opts.flags = 0;
+	if (code != JY_ERROR_DUPLICATE_KEY && !(code == JY_ERROR_STRING && has_nul_escape(buf, len)) &&
+		!jy_validate(buf, len, &opts) != !expected) {
+		printf("jy_validate disagrees on %.*s\n", (int) len, buf);
+		++failures;
+	}
+
+	free(out);
+
+	if (expected)
+		jy_free(expected);
+}
+
+static void test_errors(void) {
+	static const char nul_key[] = "{\"a\\u0000b\":1}";
+	static const char twice[] = "{\"n\":1,\"x\":0,\"n\":null}";
+	static const JYField field = { "n", JY_FIELD_NUMBER, 0, 1 };
+	JYParseOptions opts;
+	JYError error;
+	JYDocument *doc;
+	char copy[sizeof(twice)];
+	double n;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.error = &error;
+
+	/* Keys are terminated strings, so one with a NUL in it cannot be kept */
+	doc = jy_parse_n_ex(nul_key, sizeof(nul_key) - 1, &opts);
+	CHECK(!doc && error.code == JY_ERROR_STRING);
+	if (doc)
+		jy_free(doc);
+
+	/* Extracting fails on a field's key given twice, like parsing does */
+	CHECK(!jy_extract(twice, sizeof(twice) - 1, &field, 1, &n, &opts) && error.code == JY_ERROR_DUPLICATE_KEY);
+	memcpy(copy, twice, sizeof(twice));
+	CHECK(!jy_extract_insitu(copy, sizeof(twice) - 1, &field, 1, &n, &opts) && error.code == JY_ERROR_DUPLICATE_KEY);
+}
+
+static void test_engines(void) {
+	char buf[4096];
+	size_t i, len;
+
+	for (i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i)
+		compare_engines(inputs[i], strlen(inputs[i]));
+
+	for (i = 0; i < RANDOM_INPUTS; ++i) {
+		len = 0;
+		random_value(buf, &len, sizeof(buf), 0);
+		compare_engines(buf, len);
+	}
+}
+
+int main(void) {
+	test_build();
+	test_errors();
+	test_engines();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("all tests passed\n");
+	return EXIT_SUCCESS;
+}